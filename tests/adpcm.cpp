@@ -0,0 +1,125 @@
+// DESCRIPTION: Verilator: Verilog example module
+//
+// This file ONLY is placed under the Creative Commons Public Domain, for
+// any use, without warranty, 2017 by Wilson Snyder.
+// SPDX-License-Identifier: CC0-1.0
+//======================================================================
+// Include common routines
+#include <verilated.h>
+
+// Shared harness: clocking, checks and reporting
+#include "testbench.h"
+
+// Include model header, generated from Verilating "tb_top.v"
+#include "Vadpcm.h"
+
+// .mem loader, and the ADPCM encoder and reference decoder
+#include "mem_image.h"
+#include "adpcm.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Feeds codes to the model one per cycle and checks every output against
+// the reference decoder.
+void check_codes(Vadpcm* adpcm, ClockDriver<Vadpcm>& clock, Checks& checks, const std::vector<uint8_t>& codes) {
+  adpcm->rst = 1;
+  adpcm->eval();
+  adpcm->rst = 0;
+  checks(int8_t(adpcm->out) == 0);
+  adpcm->enable = 1;
+  AdpcmDecoder ref;
+  int reported = 0;
+  for (size_t i = 0; i < codes.size(); i++) {
+    adpcm->code = codes[i];
+    int8_t expected = ref.decode(codes[i]);
+    clock.step();
+    if (!checks(int8_t(adpcm->out) == expected) && reported++ < 10) {
+      std::cout << "at code " << std::to_string(i) << " (0x" << std::hex << int(codes[i]) << std::dec
+                << "), out = " << std::to_string(int8_t(adpcm->out)) << " but should be " << std::to_string(expected)
+                << " (predictor " << std::to_string(ref.predictor) << ", index " << std::to_string(ref.index) << ")\n";
+    }
+  }
+  adpcm->enable = 0;
+}
+
+int main(int argc, char **argv, char **env)
+{
+  // Prevent unused variable warnings
+  if (0 && argc && argv && env) {}
+
+  Verilated::debug(0);
+  Verilated::randReset(2);
+  Verilated::traceEverOn(true);
+  Verilated::commandArgs(argc, argv);
+
+  Vadpcm *adpcm = new Vadpcm;
+
+  ClockDriver<Vadpcm> clock(adpcm, adpcm->clk);
+  Checks checks;
+
+  adpcm->clk = 0;
+  adpcm->rst = 0;
+  adpcm->enable = 0;
+  adpcm->code = 0;
+  adpcm->eval();
+
+  /*************************************************************************/
+  // BEGIN TESTS
+  /***********************************/
+  // every drum, encoded, must decode exactly as the reference does
+  const char* drums[] = {"kick", "clap", "hihat", "snare"};
+  for (int d = 0; d < 4; d++) {
+    std::vector<uint8_t> raw = load_mem(std::string("../audio/") + drums[d] + ".mem", 4096);
+    std::vector<int8_t> pcm(raw.begin(), raw.end());
+    std::vector<uint8_t> packed = adpcm_encode(pcm);
+    std::vector<uint8_t> codes;
+    for (size_t i = 0; i < pcm.size(); i++)
+      codes.push_back((packed[i / 2] >> (4 * (i & 1))) & 0xf);
+
+    std::vector<int8_t> decoded = adpcm_decode(packed, pcm.size());
+    double signal = 0, noise = 0;
+    for (size_t i = 0; i < pcm.size(); i++) {
+      signal += pcm[i] * pcm[i];
+      noise += (decoded[i] - pcm[i]) * (decoded[i] - pcm[i]);
+    }
+    char line[128];
+    snprintf(line, sizeof(line), "%s: %zu bytes -> %zu bytes, SNR %.1f dB", drums[d], pcm.size(), packed.size(),
+             noise ? 10 * std::log10(signal / noise) : 99.0);
+    print_header(line, 70);
+
+    check_codes(adpcm, clock, checks, codes);
+    update_tests(checks, drums[d], "");
+  }
+
+  // clamping: drive the predictor and step index into both rails
+  print_header("Predictor and step index limits", 70);
+  std::vector<uint8_t> codes(200, 0x7);
+  codes.insert(codes.end(), 400, 0xf);
+  codes.insert(codes.end(), 200, 0x0);
+  srand(270);
+  for (int i = 0; i < 20000; i++)
+    codes.push_back(rand() & 0xf);
+  check_codes(adpcm, clock, checks, codes);
+  update_tests(checks, "limits", "");
+  /***********************************/
+
+  /***********************************/
+  // END TESTS
+  /*************************************************************************/
+
+  int result = report_tests();
+
+  // Final model cleanups
+  adpcm->final();
+  write_coverage();
+
+  // Destroy models
+  delete adpcm;
+  adpcm = NULL;
+
+  // Fin
+  return result;
+}
@@ -0,0 +1,95 @@
+// 4-bit IMA ADPCM for the 8-bit drum samples.
+//
+// Halves the ROM a voice needs: two codes per byte, low nibble first.
+// The predictor runs at 16 bits on samples shifted up by 8, exactly as
+// standard IMA ADPCM, and the top byte of the prediction is the output.
+// Every voice starts from predictor 0, step index 0.
+//
+// AdpcmDecoder is the bit-exact reference for workdir/adpcm.sv: each
+// code updates the state with the same integer operations the RTL uses,
+// so the two can be compared sample for sample.
+//======================================================================
+#ifndef DRUM_MACHINE_ADPCM_H
+#define DRUM_MACHINE_ADPCM_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+static const int16_t ADPCM_STEPS[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767};
+
+static const int8_t ADPCM_INDEX_ADJUST[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+struct AdpcmDecoder {
+  int32_t predictor = 0;
+  int index = 0;
+
+  // Applies one 4-bit code and returns the new 8-bit sample.
+  int8_t decode(uint8_t code) {
+    int32_t step = ADPCM_STEPS[index];
+    int32_t diff = step >> 3;
+    if (code & 4)
+      diff += step;
+    if (code & 2)
+      diff += step >> 1;
+    if (code & 1)
+      diff += step >> 2;
+    predictor += (code & 8) ? -diff : diff;
+    if (predictor > 32767)
+      predictor = 32767;
+    if (predictor < -32768)
+      predictor = -32768;
+    index += ADPCM_INDEX_ADJUST[code & 7];
+    if (index < 0)
+      index = 0;
+    if (index > 88)
+      index = 88;
+    return int8_t(predictor >> 8);
+  }
+};
+
+// Picks, for each sample, the code that brings the decoder closest to it.
+// The encoder tracks the decoder's state, so encode-then-decode never
+// drifts.
+inline std::vector<uint8_t> adpcm_encode(const std::vector<int8_t>& pcm) {
+  std::vector<uint8_t> out((pcm.size() + 1) / 2, 0);
+  AdpcmDecoder dec;
+  for (size_t i = 0; i < pcm.size(); i++) {
+    int32_t target = int32_t(pcm[i]) * 256 + 128; // middle of the 8-bit bucket
+    int32_t delta = target - dec.predictor;
+    uint8_t code = delta < 0 ? 8 : 0;
+    int32_t mag = std::abs(delta);
+    int32_t step = ADPCM_STEPS[dec.index];
+    if (mag >= step) {
+      code |= 4;
+      mag -= step;
+    }
+    if (mag >= step >> 1) {
+      code |= 2;
+      mag -= step >> 1;
+    }
+    if (mag >= step >> 2)
+      code |= 1;
+    dec.decode(code);
+    out[i / 2] |= code << (4 * (i & 1));
+  }
+  return out;
+}
+
+// Decodes n samples from packed codes.
+inline std::vector<int8_t> adpcm_decode(const std::vector<uint8_t>& codes, size_t n) {
+  std::vector<int8_t> out(n);
+  AdpcmDecoder dec;
+  for (size_t i = 0; i < n; i++)
+    out[i] = dec.decode((codes[i / 2] >> (4 * (i & 1))) & 0xf);
+  return out;
+}
+
+#endif
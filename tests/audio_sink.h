@@ -0,0 +1,182 @@
+// Where the top testbench sends its signed 16-bit mono audio.
+//
+//   +audio=alsa           play on a sound card (default)
+//   +audio=wav            write a 16-bit WAV file instead
+//   +audio=null           discard the audio, e.g. for timing a render
+//   +audio_device=name    ALSA playback device (default "default")
+//   +audio_file=name      WAV output file (default top.wav)
+//
+// Only the ALSA sink is realtime(); the testbench skips its settling
+// sleeps for the others, so headless renders run at simulation speed.
+//======================================================================
+#ifndef DRUM_MACHINE_AUDIO_SINK_H
+#define DRUM_MACHINE_AUDIO_SINK_H
+
+#include <alsa/asoundlib.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+class AudioSink {
+public:
+  virtual ~AudioSink() {}
+
+  // Writes up to n samples; returns how many were taken, or a negative
+  // error code.
+  virtual long write(const int16_t* samples, size_t n) = 0;
+  // Blocks until everything written has been played (or stored).
+  virtual void drain() {}
+  // Samples written but not yet audible.
+  virtual long queued() { return 0; }
+  // Underruns seen so far.
+  virtual uint64_t underruns() const { return 0; }
+  // Whether writes are paced by a real device.
+  virtual bool realtime() const { return false; }
+  virtual const char* name() const = 0;
+};
+
+// https://www.alsa-project.org/alsa-doc/alsa-lib/_2test_2pcm_min_8c-example.html
+class AlsaSink : public AudioSink {
+public:
+  AlsaSink(const std::string& device, unsigned rate) {
+    int err;
+    if ((err = snd_pcm_open(&handle_, device.c_str(), SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
+      printf("Playback open error: %s\n", snd_strerror(err));
+      exit(EXIT_FAILURE);
+    }
+    if ((err = snd_pcm_set_params(handle_,
+                SND_PCM_FORMAT_S16,
+                SND_PCM_ACCESS_RW_INTERLEAVED,
+                1,
+                rate,
+                1,
+                50000)) < 0) {   /* 0.05sec */
+      printf("Playback open error: %s\n", snd_strerror(err));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  ~AlsaSink() { snd_pcm_close(handle_); }
+
+  long write(const int16_t* samples, size_t n) override {
+    snd_pcm_sframes_t frames = snd_pcm_writei(handle_, samples, n);
+    if (frames == -EPIPE)
+      underruns_++;
+    if (frames < 0)
+      frames = snd_pcm_recover(handle_, frames, 1);
+    if (frames < 0)
+      printf("snd_pcm_writei failed: %s\n", snd_strerror(frames));
+    return frames;
+  }
+
+  void drain() override { snd_pcm_drain(handle_); }
+
+  long queued() override {
+    snd_pcm_sframes_t frames = 0;
+    if (snd_pcm_delay(handle_, &frames) < 0)
+      return 0;
+    return frames;
+  }
+
+  uint64_t underruns() const override { return underruns_; }
+  bool realtime() const override { return true; }
+  const char* name() const override { return "alsa"; }
+
+private:
+  snd_pcm_t* handle_ = NULL;
+  uint64_t underruns_ = 0;
+};
+
+// Canonical 44-byte RIFF header; the two sizes are patched on close.
+// Samples are written in host order, which is little-endian like WAV on
+// every machine the testbench runs on.
+class WavSink : public AudioSink {
+public:
+  WavSink(const std::string& filename, unsigned rate) : filename_(filename) {
+    file_ = fopen(filename.c_str(), "wb");
+    if (!file_) {
+      printf("Cannot open %s for writing\n", filename.c_str());
+      exit(EXIT_FAILURE);
+    }
+    header(rate, 0);
+  }
+
+  ~WavSink() {
+    header(rate_, bytes_);
+    fclose(file_);
+    printf("Wrote %llu samples to %s\n", (unsigned long long)bytes_ / 2, filename_.c_str());
+  }
+
+  long write(const int16_t* samples, size_t n) override {
+    size_t done = fwrite(samples, 2, n, file_);
+    bytes_ += done * 2;
+    return done == n ? (long)done : -EIO;
+  }
+
+  const char* name() const override { return "wav"; }
+
+private:
+  void put32(uint32_t v) {
+    uint8_t b[4] = {uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24)};
+    fwrite(b, 1, 4, file_);
+  }
+  void put16(uint16_t v) {
+    uint8_t b[2] = {uint8_t(v), uint8_t(v >> 8)};
+    fwrite(b, 1, 2, file_);
+  }
+
+  void header(unsigned rate, uint64_t bytes) {
+    rate_ = rate;
+    fseek(file_, 0, SEEK_SET);
+    fwrite("RIFF", 1, 4, file_);
+    put32(uint32_t(36 + bytes));
+    fwrite("WAVEfmt ", 1, 8, file_);
+    put32(16);   // fmt chunk size
+    put16(1);    // PCM
+    put16(1);    // mono
+    put32(rate);
+    put32(rate * 2); // byte rate
+    put16(2);    // block align
+    put16(16);   // bits per sample
+    fwrite("data", 1, 4, file_);
+    put32(uint32_t(bytes));
+    fseek(file_, 0, SEEK_END);
+  }
+
+  std::string filename_;
+  FILE* file_ = NULL;
+  unsigned rate_ = 0;
+  uint64_t bytes_ = 0;
+};
+
+class NullSink : public AudioSink {
+public:
+  long write(const int16_t*, size_t n) override { return n; }
+  const char* name() const override { return "null"; }
+};
+
+// Picks the sink from the +audio* plusargs.
+inline AudioSink* make_audio_sink(int argc, char** argv, unsigned rate) {
+  std::string kind = "alsa", device = "default", filename = "top.wav";
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (!arg.compare(0, 7, "+audio="))
+      kind = arg.substr(7);
+    else if (!arg.compare(0, 14, "+audio_device="))
+      device = arg.substr(14);
+    else if (!arg.compare(0, 12, "+audio_file="))
+      filename = arg.substr(12);
+  }
+  if (kind == "alsa")
+    return new AlsaSink(device, rate);
+  if (kind == "wav")
+    return new WavSink(filename, rate);
+  if (kind == "null")
+    return new NullSink;
+  printf("Unknown +audio=%s (expected alsa, wav or null)\n", kind.c_str());
+  exit(EXIT_FAILURE);
+}
+
+#endif
@@ -0,0 +1,222 @@
+// Streaming playback of rendered audio for the top testbench.
+//
+// The simulation thread push()es demodulated samples into a lock-free
+// single-producer/single-consumer ring; an audio thread drains the ring to
+// the audio sink as soon as enough has been buffered.  Long patterns can then be
+// auditioned while they render instead of after the whole batch.
+//
+// Counters are printed by close():
+//   underruns  the sink ran dry (ALSA -EPIPE) and had to be re-prepared
+//   stalls     times the audio thread ran the ring dry (sim slower than
+//              real time, or not recording)
+//   fill       ring occupancy seen by the audio thread, average and peak
+//   latency    push() to DAC: time in the ring plus the sink's queued frames
+//======================================================================
+#ifndef DRUM_MACHINE_AUDIO_STREAM_H
+#define DRUM_MACHINE_AUDIO_STREAM_H
+
+#include "audio_sink.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Lock-free ring for exactly one producer thread and one consumer thread.
+// Capacity is rounded up to a power of two; indices grow without wrapping
+// and are masked on access.
+template <class T>
+class SpscRing {
+public:
+  explicit SpscRing(size_t capacity) {
+    size_t n = 1;
+    while (n < capacity)
+      n <<= 1;
+    buf_.resize(n);
+    mask_ = n - 1;
+  }
+
+  // Copies up to n items in; returns how many fitted.
+  size_t push(const T* src, size_t n) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t room = buf_.size() - (tail - head);
+    if (n > room)
+      n = room;
+    for (size_t i = 0; i < n; i++)
+      buf_[(tail + i) & mask_] = src[i];
+    tail_.store(tail + n, std::memory_order_release);
+    return n;
+  }
+
+  // Copies up to n items out; returns how many there were.
+  size_t pop(T* dst, size_t n) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    if (n > tail - head)
+      n = tail - head;
+    for (size_t i = 0; i < n; i++)
+      dst[i] = buf_[(head + i) & mask_];
+    head_.store(head + n, std::memory_order_release);
+    return n;
+  }
+
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+  size_t capacity() const { return buf_.size(); }
+
+private:
+  std::vector<T> buf_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> head_{0}; // advanced by the consumer
+  alignas(64) std::atomic<size_t> tail_{0}; // advanced by the producer
+};
+
+class AudioStream {
+public:
+  // Playback starts once prebuffer samples are queued, or on close().
+  // marks_ has room for a mark in every block of the ring and of the chunk
+  // being written, and the one push() makes before the ring has room.
+  AudioStream(AudioSink* sink, unsigned rate, size_t capacity, size_t prebuffer)
+      : sink_(sink), rate_(rate), ring_(capacity), marks_((ring_.capacity() + CHUNK) / MARK_EVERY + 3),
+        prebuffer_(prebuffer < ring_.capacity() ? prebuffer : ring_.capacity()) {
+    thread_ = std::thread(&AudioStream::drain, this);
+  }
+
+  ~AudioStream() { close(); }
+
+  // Simulation thread only.  Blocks (yielding) while the ring is full, so
+  // a render faster than real time is throttled to the DAC.
+  void push(const int16_t* samples, size_t n) {
+    while (n) {
+      // once per block, not again on every retry while the ring is full
+      if (pushed_ == next_mark_) {
+        Mark m = {pushed_, now_ns()};
+        marks_.push(&m, 1);
+        next_mark_ += MARK_EVERY;
+      }
+      size_t chunk = MARK_EVERY - pushed_ % MARK_EVERY;
+      if (chunk > n)
+        chunk = n;
+      size_t done = ring_.push(samples, chunk);
+      if (!done) {
+        std::this_thread::yield();
+        continue;
+      }
+      pushed_ += done;
+      samples += done;
+      n -= done;
+    }
+  }
+  void push(int16_t sample) { push(&sample, 1); }
+
+  // Lets the audio thread play out what is queued, then joins it.
+  void close() {
+    if (!thread_.joinable())
+      return;
+    done_.store(true, std::memory_order_release);
+    thread_.join();
+    sink_->drain();
+    std::printf("stream: %llu samples, %llu underruns, %llu stalls, fill avg %.0f / peak %llu of %llu, "
+                "latency avg %.1f ms / peak %.1f ms\n",
+                (unsigned long long)written_, (unsigned long long)sink_->underruns(), (unsigned long long)stalls_,
+                fill_polls_ ? (double)fill_sum_ / fill_polls_ : 0.0, (unsigned long long)fill_peak_,
+                (unsigned long long)ring_.capacity(),
+                latency_count_ ? latency_sum_ms_ / latency_count_ : 0.0, latency_peak_ms_);
+  }
+
+  // Marks whose latency was measured, one per MARK_EVERY samples played;
+  // read after close().
+  uint64_t marks() const { return latency_count_; }
+
+private:
+  static const size_t MARK_EVERY = 80; // about 10 ms of top's audio
+  static const size_t CHUNK = 256;
+
+  struct Mark {
+    uint64_t index;
+    uint64_t time_ns;
+  };
+
+  static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // Audio thread.
+  void drain() {
+    int16_t buf[CHUNK];
+    bool started = false;
+    Mark mark;
+    bool have_mark = false;
+    bool dry = false;
+    for (;;) {
+      size_t fill = ring_.size();
+      bool done = done_.load(std::memory_order_acquire);
+      if (!started && fill < prebuffer_ && !done) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
+      }
+      started = true;
+      fill_sum_ += fill;
+      fill_polls_++;
+      if (fill > fill_peak_)
+        fill_peak_ = fill;
+
+      size_t n = ring_.pop(buf, CHUNK);
+      if (!n) {
+        if (done && !ring_.size())
+          break;
+        stalls_ += !dry;
+        dry = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
+      }
+
+      dry = false;
+      size_t off = 0;
+      while (off < n) {
+        long frames = sink_->write(buf + off, n - off);
+        if (frames < 0)
+          break;
+        off += frames;
+      }
+
+      // Latency of every mark that has now reached ALSA.
+      uint64_t reached = written_ + n;
+      while ((have_mark || (have_mark = marks_.pop(&mark, 1))) && mark.index < reached) {
+        double ms = (now_ns() - mark.time_ns) / 1e6 + sink_->queued() * 1000.0 / rate_;
+        latency_sum_ms_ += ms;
+        latency_count_++;
+        if (ms > latency_peak_ms_)
+          latency_peak_ms_ = ms;
+        have_mark = false;
+      }
+      written_ = reached;
+    }
+  }
+
+  AudioSink* sink_;
+  unsigned rate_;
+  SpscRing<int16_t> ring_;
+  SpscRing<Mark> marks_;
+  size_t prebuffer_;
+  std::thread thread_;
+  std::atomic<bool> done_{false};
+
+  // producer side
+  uint64_t pushed_ = 0;
+  uint64_t next_mark_ = 0;
+
+  // consumer side, read by close() after the join
+  uint64_t written_ = 0;
+  uint64_t stalls_ = 0;
+  uint64_t fill_sum_ = 0, fill_polls_ = 0, fill_peak_ = 0;
+  double latency_sum_ms_ = 0, latency_peak_ms_ = 0;
+  uint64_t latency_count_ = 0;
+};
+
+#endif
@@ -0,0 +1,325 @@
+// Multi-clock scheduling for Verilated models.
+//
+// ClockDriver (testbench.h) drives one clock.  A ClockScheduler drives any
+// number of them, each declared once with an exact period and phase, or as
+// a divided copy of another clock:
+//
+//   ClockScheduler<Vice40hx8k> clocks(board, contextp);
+//   int hwclk = clocks.add(board->hwclk, 2);          // 12 MHz, 1 unit = 1/24 us
+//   int hz2m  = clocks.divide(board->hz2m, hwclk, 6);
+//   int hz100 = clocks.divide(board->hz100, hwclk, 120000);
+//   clocks.step(hz100, 10);                           // ten hz100 cycles
+//
+// A clock from add() rises at phase, phase + period, ... and falls half a
+// period (rounded down) after each rise.  Its edges are kept in a timing
+// wheel of SLOTS slots, one per quantum (the gcd of every half period and
+// phase), with a bitmap of the slots in use, so finding the next edge is a
+// few word tests however sparse the clocks are.  An edge more than SLOTS
+// quanta ahead waits in its slot for a later turn of the wheel.  A single
+// free-running clock, the usual case, is stepped without the wheel.
+//
+// A clock from divide() toggles on every ratio/2-th rising edge of its
+// source, as the output of a divider flop does: after the source edge has
+// been evaluated, in an eval of its own, and at the same time.  Divided
+// clocks of divided clocks follow in turn.
+//
+// eval() is only called for edges that change a pin: all the edges of
+// one time go into one eval, then one per level of divided clocks, and
+// the hook is called once with the time, as ClockDriver calls it once per
+// edge.  With a context, the scheduler sets its time to each edge's.
+//======================================================================
+#ifndef DRUM_MACHINE_CLOCK_SCHEDULER_H
+#define DRUM_MACHINE_CLOCK_SCHEDULER_H
+
+#include "testbench.h"
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+template <class Vmodel, class EdgeHook = NoEdgeHook>
+class ClockScheduler {
+public:
+  static const unsigned SLOTS = 256;
+
+  ClockScheduler(Vmodel* model, VerilatedContext* contextp = nullptr, EdgeHook hook = EdgeHook())
+      : model_(model), contextp_(contextp), hook_(hook) {}
+
+  // A free-running clock on pin; returns its id.  period is in time units
+  // and at least 2.
+  int add(CData& pin, uint64_t period, uint64_t phase = 0) {
+    assert(period >= 2);
+    Clock c(pin);
+    c.high = period / 2;
+    c.low = period - c.high;
+    c.phase = phase % period;
+    clocks_.push_back(c);
+    started_ = false;
+    return clocks_.size() - 1;
+  }
+
+  // pin toggled every ratio/2 rising edges of clock source; returns its id.
+  // ratio is even, so the divided clock has a 50% duty cycle.
+  int divide(CData& pin, int source, uint64_t ratio) {
+    assert(ratio >= 2 && ratio % 2 == 0 && source < (int)clocks_.size());
+    Clock c(pin);
+    c.source = source;
+    c.half_ratio = ratio / 2;
+    clocks_.push_back(c);
+    clocks_[source].divided.push_back(clocks_.size() - 1);
+    return clocks_.size() - 1;
+  }
+
+  // Runs until clock c has risen n more times, including any divided
+  // clocks that toggle on the last of those edges.
+  void step(int c, uint64_t n = 1) {
+    uint64_t target = clocks_[c].rises + n;
+    start();
+    while (clocks_[c].rises < target)
+      next();
+  }
+
+  // Runs every edge up to and including time t.
+  void run_until(uint64_t t) {
+    start();
+    while (true) {
+      uint64_t tick = single_ >= 0 ? clocks_[single_].due : next_tick();
+      if (tick * quantum_ > t)
+        break;
+      next();
+    }
+    set_time(t);
+    tick_ = t / quantum_;
+  }
+
+  uint64_t time() const { return contextp_ ? contextp_->time() : now_; }
+  // Rising edges, and all edges, of clock c so far.
+  uint64_t rises(int c) const { return clocks_[c].rises; }
+  uint64_t edges(int c) const { return clocks_[c].edges; }
+  // For a divided clock, rising edges of its source since it last toggled.
+  uint64_t count(int c) const { return clocks_[c].count; }
+  void set_count(int c, uint64_t n) { clocks_[c].count = n; }
+  // eval() calls so far.
+  uint64_t evals() const { return evals_; }
+
+  // Schedules every clock again from the current time, e.g. after the
+  // time and model have been restored from a checkpoint.  Pins keep their
+  // levels.
+  void restart() { started_ = false; }
+
+  EdgeHook& hook() { return hook_; }
+
+private:
+  static const unsigned MASK = SLOTS - 1;
+  static const unsigned WORDS = SLOTS / 64;
+
+  struct Clock {
+    explicit Clock(CData& p) : pin(&p) {}
+    CData* pin;
+    // free-running: ticks high and low, phase in time units
+    uint64_t high = 0, low = 0, phase = 0;
+    // divided: the source clock and rising edges per toggle
+    int source = -1;
+    uint64_t half_ratio = 0, count = 0;
+    std::vector<int> divided;
+    uint64_t rises = 0, edges = 0;
+    // free-running: high and low in ticks, the next edge, and the next
+    // clock in its slot
+    uint64_t high_ticks = 0, low_ticks = 0;
+    uint64_t due = 0;
+    CData level = 0;
+    int link = -1;
+  };
+
+  static uint64_t gcd(uint64_t a, uint64_t b) {
+    while (b) {
+      uint64_t r = a % b;
+      a = b;
+      b = r;
+    }
+    return a;
+  }
+
+  inline void set_time(uint64_t t) {
+    if (contextp_)
+      contextp_->timeInc(t - now_);
+    now_ = t;
+  }
+
+  // Works out the quantum and puts the first edge of each free-running
+  // clock after the current time on the wheel.
+  void start() {
+    if (started_)
+      return;
+    started_ = true;
+    quantum_ = 0;
+    for (const Clock& c : clocks_)
+      if (c.source < 0)
+        quantum_ = gcd(gcd(quantum_, c.phase), gcd(c.high, c.low));
+    if (!quantum_)
+      quantum_ = 1;
+    for (int& h : head_)
+      h = -1;
+    for (uint64_t& w : occupied_)
+      w = 0;
+    uint64_t now = now_ = time();
+    tick_ = now / quantum_;
+    single_ = -1;
+    int free_running = 0;
+    for (size_t i = 0; i < clocks_.size(); i++)
+      if (clocks_[i].source < 0 && free_running++ == 0)
+        single_ = i;
+    if (free_running > 1)
+      single_ = -1;
+    for (size_t i = 0; i < clocks_.size(); i++) {
+      Clock& c = clocks_[i];
+      if (c.source >= 0)
+        continue;
+      c.high_ticks = c.high / quantum_;
+      c.low_ticks = c.low / quantum_;
+      // time of the last rise at or before now, and the edges after it
+      uint64_t period = c.high + c.low;
+      uint64_t rise = now >= c.phase ? now - (now - c.phase) % period : c.phase;
+      if (rise > now)
+        schedule(i, rise / quantum_, 1);
+      else if (rise + c.high > now)
+        schedule(i, (rise + c.high) / quantum_, 0);
+      else
+        schedule(i, (rise + period) / quantum_, 1);
+    }
+  }
+
+  inline void schedule(int id, uint64_t tick, CData level) {
+    Clock& c = clocks_[id];
+    unsigned slot = tick & MASK;
+    c.due = tick;
+    c.level = level;
+    c.link = head_[slot];
+    head_[slot] = id;
+    occupied_[slot >> 6] |= 1ull << (slot & 63);
+  }
+
+  // The tick of the next slot in use after tick_.
+  inline uint64_t next_tick() const {
+    unsigned first = (tick_ + 1) & MASK;
+    // the usual case: an edge in the very next slot
+    if (occupied_[first >> 6] >> (first & 63) & 1)
+      return tick_ + 1;
+    for (unsigned i = 0; i <= WORDS; i++) {
+      unsigned w = ((first >> 6) + i) % WORDS;
+      uint64_t bits = occupied_[w];
+      if (i == 0)
+        bits &= ~0ull << (first & 63);
+      else if (i == WORDS)
+        bits &= (1ull << (first & 63)) - 1;
+      if (bits) {
+        unsigned slot = w * 64 + __builtin_ctzll(bits);
+        return tick_ + 1 + ((slot - first) & MASK);
+      }
+    }
+    assert(!"ClockScheduler has no free-running clock");
+    return tick_ + 1;
+  }
+
+  // Applies the edges on the wheel at the next slot in use, then the
+  // divided clocks they drive.  The scheduler must be started.
+  inline void next() {
+    bool changed = false;
+    if (single_ >= 0) {
+      // one free-running clock: its next edge is the next time
+      Clock& c = clocks_[single_];
+      CData level = c.level;
+      tick_ = c.due;
+      changed = toggle(c, level, single_);
+      c.due += level ? c.high_ticks : c.low_ticks;
+      c.level = !level;
+      finish(changed);
+      return;
+    }
+    tick_ = next_tick();
+    unsigned slot = tick_ & MASK;
+    // unlink the clocks due now; an edge rescheduled into this slot goes
+    // in front of the walk and is not seen again
+    for (int* p = &head_[slot]; *p >= 0;) {
+      int id = *p;
+      Clock& c = clocks_[id];
+      if (c.due != tick_) {
+        p = &c.link;
+        continue;
+      }
+      *p = c.link;
+      CData level = c.level;
+      changed |= toggle(c, level, id);
+      schedule(id, tick_ + (level ? c.high_ticks : c.low_ticks), !level);
+    }
+    if (head_[slot] < 0)
+      occupied_[slot >> 6] &= ~(1ull << (slot & 63));
+    finish(changed);
+  }
+
+  // Evaluates the edges of this tick, if any changed a pin, then the
+  // divided clocks they drive.
+  inline void finish(bool changed) {
+    set_time(tick_ * quantum_);
+    if (changed) {
+      model_->eval();
+      evals_++;
+    }
+
+    // divided clocks, one level per eval; toggle() appends the clocks
+    // that rose to rose_ for the next level
+    for (size_t begin = 0; begin < rose_.size();) {
+      size_t end = rose_.size();
+      bool any = false;
+      for (size_t i = begin; i < end; i++)
+        for (int d : clocks_[rose_[i]].divided) {
+          Clock& c = clocks_[d];
+          if (++c.count == c.half_ratio) {
+            c.count = 0;
+            any |= toggle(c, !*c.pin, d);
+          }
+        }
+      if (any) {
+        model_->eval();
+        evals_++;
+      }
+      begin = end;
+    }
+    rose_.clear();
+    if (contextp_ && changed)
+      hook_(contextp_->time());
+  }
+
+  // Sets clock c's pin to level; returns whether it changed, and notes
+  // the clock in rose_ if it rose and has clocks divided from it.
+  inline bool toggle(Clock& c, CData level, int id) {
+    if (*c.pin == level)
+      return false;
+    *c.pin = level;
+    c.edges++;
+    if (level) {
+      c.rises++;
+      if (!c.divided.empty())
+        rose_.push_back(id);
+    }
+    return true;
+  }
+
+  Vmodel* model_;
+  VerilatedContext* contextp_;
+  EdgeHook hook_;
+  std::vector<Clock> clocks_;
+  // clocks that rose in this step and drive divided clocks
+  std::vector<int> rose_;
+
+  // the first clock with an edge in each slot, -1 for none
+  int head_[SLOTS];
+  uint64_t occupied_[WORDS] = {};
+  uint64_t tick_ = 0, quantum_ = 1, now_ = 0;
+  uint64_t evals_ = 0;
+  // the only free-running clock, which needs no wheel, or -1
+  int single_ = -1;
+  bool started_ = false;
+};
+
+#endif
@@ -7,74 +7,18 @@
 // Include common routines
 #include <verilated.h>
 
-static int passed_test_count = 0; // every time we perform a test, and the test passes, increment this by one.
-static int total_test_count = 0;  // every time we perform a test, increment this by one.
+// Shared harness: clocking, checks and reporting
+#include "testbench.h"
 
 // Include model header, generated from Verilating "tb_top.v"
 #include "Vcontroller.h"
 
-// Verilator using new C++?  Need to include these now (sstep2021)
-#include <iostream>
-using namespace std;
-
-// Current simulation time (64-bit unsigned)
-vluint64_t main_time = 0;
-// Called by $time in Verilog
-double sc_time_stamp()
-{
-  return main_time; // Note does conversion to real, to match SystemC
-}
-
-int concat(int w, int a, int b)
-{
-  return (a << w) | b;
-}
-
-std::string bin(int b)
-{
-  std::string ans;
-  while (b != 0)
-  {
-    ans += b % 2 == 0 ? "0" : "1";
-    b /= 2;
-  }
-  std::reverse(ans.begin(), ans.end());
-  return ans;
-}
-
-int pin(int a, int b) {
-  return (a >> b) & 1;
-}
-
-int pinsel(int x, int a, int b) {
-    assert(a < b);
-    int y = 0;
-    for (int i = a; i <= b; i++) {
-        y |= pin(x, i);
-    }
-    return y;
-}
-
-void update_tests(int passed, int total, std::string test) {
-  // add tests to global test variables
-  passed_test_count += passed;
-  total_test_count += total;
-  // perform sanity check on global test variables
-  assert(passed_test_count <= total_test_count);
-  // let TA know if this set of tests failed
-  std::cout << "controller: " << std::to_string(passed) << " out of " << std::to_string(total) << " tests passed.\n";
-}
-
-void cycle_clock(Vcontroller* controller) {
-    controller->clk = 1; controller->eval();
-    controller->clk = 0; controller->eval();
-}
 void assert_reset(Vcontroller* controller) {
     controller->rst = 1; controller->eval();
     controller->rst = 0; controller->eval();
 }
 
-void check_output(std::string state, bool cond, std::string test, int* passed, int* total) {
+void check_output(std::string state, bool cond, std::string test, Checks& checks) {
   /* 1	Blue	9	Light Blue
    2	Green	0	Black
    3	Aqua	10	Light Green
@@ -82,8 +26,7 @@ void check_output(std::string state, bool cond, std::string test, int* passed, i
    5	Purple	12	Light Red
    7	White	14	Light Yellow
    8	Gray	15	Bright White */
-  if (cond) {
-    (*passed)++;
+  if (checks(cond)) {
     std::cout << "\033[0;32m";
     std::cout<<"[PASS] ";
 
@@ -93,19 +36,6 @@ void check_output(std::string state, bool cond, std::string test, int* passed, i
   }
   std::cout << "\033[0m";
   std::cout << state << ": Checking if " << test << "\n";
-  (*total)++;
-}
-
-// write a C++ function that takes a string, and pads it with dashes on both sides of the string 
-// such that the total length of the output string is 80 characters, and prints it out.
-void print_header(std::string s) {
-  int n = s.length();
-  int pad = (50 - n) / 2;
-  std::string dashes = "";
-  for (int i = 0; i < pad; i++) {
-    dashes += "-";
-  }
-  std::cout << dashes << " " << s << " " << dashes << "\n";
 }
 
 int main(int argc, char **argv, char **env)
@@ -133,8 +63,8 @@ int main(int argc, char **argv, char **env)
   // Construct the Verilated model, from each module after Verilating each module file
   Vcontroller *controller = new Vcontroller; // Or use a const unique_ptr, or the VL_UNIQUE_PTR wrapper
 
-  int passed_subtests = 0; // if we have multiple subtests, we need to know how many passed for each
-  int total_subtests = 0;
+  ClockDriver<Vcontroller> clock(controller, controller->clk);
+  Checks checks; // if we have multiple subtests, we need to know how many passed for each
 
   /*************************************************************************/
   // BEGIN TESTS
@@ -154,41 +84,41 @@ int main(int argc, char **argv, char **env)
   controller->eval();
   print_header("Power-on: testing reset");
   assert_reset(controller);
-  check_output("RESET", controller->mode == EDIT, "state == EDIT", &passed_subtests, &total_subtests);
+  check_output("RESET", controller->mode == EDIT, "state == EDIT", checks);
   
   print_header("Testing EDIT -> EDIT, shouldn't change");
   // then, shiftdown should be empty, so we assert the corresponding signal
   controller->set_edit = 1; controller->eval();
-  cycle_clock(controller);
-  check_output("EDIT", controller->mode == EDIT, "state == EDIT", &passed_subtests, &total_subtests);
+  clock.step();
+  check_output("EDIT", controller->mode == EDIT, "state == EDIT", checks);
 
   // strobe=1, change state to PLAY
   print_header("Testing EDIT -> PLAY");
   controller->set_edit = 0;
   controller->set_play = 1; controller->eval();
-  cycle_clock(controller);
-  check_output("PLAY", controller->mode == PLAY, "state == PLAY", &passed_subtests, &total_subtests);
+  clock.step();
+  check_output("PLAY", controller->mode == PLAY, "state == PLAY", checks);
   controller->set_play = 0; controller->eval();
-  cycle_clock(controller);
-  check_output("PLAY_2", controller->mode == PLAY, "state == PLAY", &passed_subtests, &total_subtests);
+  clock.step();
+  check_output("PLAY_2", controller->mode == PLAY, "state == PLAY", checks);
 
   // strobe=1, change state to RAW
   print_header("Testing PLAY -> RAW");
   controller->set_raw = 1; controller->eval();
-  cycle_clock(controller);
-  cycle_clock(controller);
-  check_output("RAW", controller->mode == RAW, "state == RAW", &passed_subtests, &total_subtests);
+  clock.step();
+  clock.step();
+  check_output("RAW", controller->mode == RAW, "state == RAW", checks);
   controller->set_raw = 0; controller->eval();
-  cycle_clock(controller);
-  check_output("RAW_2", controller->mode == RAW, "state == RAW", &passed_subtests, &total_subtests);
+  clock.step();
+  check_output("RAW_2", controller->mode == RAW, "state == RAW", checks);
 
   // strobe=1 change state to EDIT
   print_header("Testing RAW -> EDIT");
   controller->set_edit = 1; controller->eval();
-  cycle_clock(controller);
-  check_output("EDIT", controller->mode == EDIT, "state == EDIT", &passed_subtests, &total_subtests);
-  cycle_clock(controller);
-  check_output("EDIT_2", controller->mode == EDIT, "state == EDIT", &passed_subtests, &total_subtests);
+  clock.step();
+  check_output("EDIT", controller->mode == EDIT, "state == EDIT", checks);
+  clock.step();
+  check_output("EDIT_2", controller->mode == EDIT, "state == EDIT", checks);
 
   // shiftdown reset is asserted, so set_play should not be true anymore
   print_header("Post-operation reset");
@@ -196,22 +126,20 @@ int main(int argc, char **argv, char **env)
   controller->set_raw = 0; controller->eval();
   controller->set_edit = 0; controller->eval();
   controller->rst = 1; controller->eval();
-  check_output("POSTRESET", controller->mode == EDIT, "state == EDIT", &passed_subtests, &total_subtests);
+  check_output("POSTRESET", controller->mode == EDIT, "state == EDIT", checks);
   
   std::cout << std::endl;
  
-  update_tests(passed_subtests, total_subtests, "1");
+  update_tests(checks, "controller", "");
   /***********************************/
 
-  passed_subtests = 0;
-  total_subtests = 0;
-
   /***********************************/
   // END TESTS
   /*************************************************************************/
 
   // good to have to detect bugs in the testbench
   assert(passed_test_count <= total_test_count);
+  write_results();
 
   if (passed_test_count == total_test_count)
   {
@@ -235,6 +163,7 @@ int main(int argc, char **argv, char **env)
 
   // Final model cleanups
   controller->final();
+  write_coverage();
 
   // Destroy models
   delete controller;
@@ -0,0 +1,100 @@
+// Fan-out of scenarios from a shared simulation prefix.
+//
+// A testbench simulates the state every scenario starts from once, then
+// fork_scenarios() forks one child process per scenario.  Each child gets a
+// copy-on-write copy of the whole process, models included, so it
+// continues from the prefix without replaying it, and only the pages it
+// touches are copied.  Children run at most `jobs` at a time and hand
+// their results back through a slot of shared memory; the parent waits for
+// all of them and gets each child's exit status.
+//
+// A child must not touch anything another process is also writing: an
+// open trace file, a sound device or a thread's queue.  Callers disable
+// those before fanning out.
+//======================================================================
+#ifndef DRUM_MACHINE_FORK_SCENARIOS_H
+#define DRUM_MACHINE_FORK_SCENARIOS_H
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Shared result slots, one Slot per scenario, visible to parent and
+// children alike.
+template <class Slot>
+class SharedSlots {
+public:
+  explicit SharedSlots(size_t n) : n_(n) {
+    void* p = mmap(NULL, bytes(), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      perror("fork_scenarios: mmap");
+      exit(EXIT_FAILURE);
+    }
+    slots_ = static_cast<Slot*>(p);
+  }
+  ~SharedSlots() { munmap(slots_, bytes()); }
+  SharedSlots(const SharedSlots&) = delete;
+  SharedSlots& operator=(const SharedSlots&) = delete;
+
+  Slot& operator[](size_t i) { return slots_[i]; }
+  size_t size() const { return n_; }
+
+private:
+  size_t bytes() const { return n_ * sizeof(Slot); }
+
+  size_t n_;
+  Slot* slots_;
+};
+
+// Runs scenario(i, slots[i]) in a child process for every i, at most jobs
+// children at a time, and returns each child's exit status: what scenario
+// returned, or -1 if the child died.  Output buffered before the fork is
+// flushed first so no child prints it again.
+template <class Slot, class Scenario>
+std::vector<int> fork_scenarios(SharedSlots<Slot>& slots, unsigned jobs, Scenario scenario) {
+  std::vector<int> status(slots.size(), -1);
+  std::vector<pid_t> pids(slots.size(), -1);
+  size_t next = 0, running = 0;
+  if (!jobs)
+    jobs = 1;
+  std::cout.flush();
+  fflush(stdout);
+
+  while (next < slots.size() || running) {
+    if (next < slots.size() && running < jobs) {
+      pid_t pid = fork();
+      if (pid < 0) {
+        perror("fork_scenarios: fork");
+        exit(EXIT_FAILURE);
+      }
+      if (pid == 0) {
+        int code = scenario(next, slots[next]);
+        std::cout.flush();
+        fflush(stdout);
+        // skip the parent's atexit handlers and static destructors
+        _exit(code);
+      }
+      pids[next++] = pid;
+      running++;
+      continue;
+    }
+    int wstatus;
+    pid_t done = wait(&wstatus);
+    if (done < 0) {
+      perror("fork_scenarios: wait");
+      exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < pids.size(); i++)
+      if (pids[i] == done)
+        status[i] = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : -1;
+    running--;
+  }
+  return status;
+}
+
+#endif
@@ -0,0 +1,193 @@
+// DESCRIPTION: Verilator: Verilog example module
+//
+// This file ONLY is placed under the Creative Commons Public Domain, for
+// any use, without warranty, 2017 by Wilson Snyder.
+// SPDX-License-Identifier: CC0-1.0
+//======================================================================
+// Full-board simulation of support/ice40hx8k.sv: top inside the wrapper
+// that is flashed, with the wrapper's own hz2m and hz100 dividers,
+// reset_on_start and the UART, and a behavioral SB_PLL40_CORE
+// (support/sim/SB_PLL40_CORE.sv) for its serclk.  The harness drives only
+// what the board does: hwclk at 12 MHz, pb and Rx.  Everything else is
+// derived in the RTL, so a clock that runs at the wrong ratio here runs
+// at the wrong ratio on the board too.
+//
+// Every hwclk edge is an eval, six hwclk cycles per hz2m cycle, so this
+// costs about twelve times what top.cpp does per hz2m cycle.  The last
+// line gives the cost in the format of make bench.
+//
+//   +rx=text   bytes sent to Rx at 115200 baud in Test 4 (default "drum")
+//======================================================================
+// Include common routines
+#include <verilated.h>
+
+// Shared harness: clocking, checks and reporting
+#include "testbench.h"
+#include "clock_scheduler.h"
+
+// Include model header, generated from Verilating "ice40hx8k.sv"; the
+// internal clocks are read through rootp, made public by
+// support/sim/ice40hx8k.vlt
+#include "Vice40hx8k.h"
+#include "Vice40hx8k___024root.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// One time unit is half a hwclk period.
+static const double TIME_HZ = 24000000;
+static const uint64_t HWCLK_PER_HZ2M = 6;
+static const uint64_t HWCLK_PER_HZ100 = 120000;
+static const double BAUD = 115200;
+
+static const int TO_RAW = 16;
+
+// An internal clock watched on every hwclk edge: its rising edges and the
+// times of the first and latest.
+struct Probe {
+  const CData* signal;
+  CData last;
+  uint64_t rises, first, latest;
+};
+static std::vector<Probe> probes;
+
+struct ProbeHook {
+  inline void operator()(uint64_t time) {
+    for (Probe& p : probes) {
+      if (*p.signal && !p.last) {
+        if (!p.rises++)
+          p.first = time;
+        p.latest = time;
+      }
+      p.last = *p.signal;
+    }
+  }
+};
+
+const std::unique_ptr<VerilatedContext> contextp{new VerilatedContext};
+static ClockScheduler<Vice40hx8k, ProbeHook>* clocks = NULL;
+static int hwclk_clock;
+
+// n hwclk cycles.
+void cycle_hwclk(uint64_t n) {
+  clocks->step(hwclk_clock, n);
+  cycle_count = clocks->rises(hwclk_clock);
+}
+
+// Sends c on Rx as one 8N1 frame at BAUD, followed by a bit of idle line.
+// Bit edges are rounded to the nearest hwclk edge, so the rate is exact
+// over the frame.
+void send_byte(Vice40hx8k* board, uint8_t c) {
+  uint64_t start = clocks->time();
+  int frame = c << 1 | 0x600;  // start bit, data LSB first, stop bit, idle
+  for (int i = 0; i < 11; i++) {
+    board->Rx = frame >> i & 1;
+    clocks->run_until(start + std::llround((i + 1) * TIME_HZ / BAUD));
+  }
+  cycle_count = clocks->rises(hwclk_clock);
+}
+
+int main(int argc, char **argv, char **env)
+{
+  // Prevent unused variable warnings
+  if (0 && argc && argv && env) {}
+
+  Verilated::debug(0);
+  Verilated::randReset(2);
+  Verilated::commandArgs(argc, argv);
+
+  std::string rx = plusarg("rx", "drum");
+  std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+  Vice40hx8k *board = new Vice40hx8k(contextp.get());
+  Vice40hx8k___024root* root = board->rootp;
+  clocks = new ClockScheduler<Vice40hx8k, ProbeHook>(board, contextp.get());
+  Checks checks;
+
+  board->hwclk = 0;
+  board->pb = 0;
+  board->Rx = 1;
+  board->eval();
+  hwclk_clock = clocks->add(board->hwclk, 2);
+
+  /////////////////////////////////////////////////////////////
+  // reset_on_start holds reset for four hz2m cycles after power-on; top
+  // should come out of it in EDIT mode with no help from the harness.
+  probes = {{&root->ice40hx8k__DOT__reset, root->ice40hx8k__DOT__reset, 0, 0, 0}};
+  cycle_hwclk(HWCLK_PER_HZ2M * 16);
+  std::cout << "Test 1: After power-on, reset_on_start should pulse reset once and leave top in EDIT mode." << "\n";
+  std::cout << "reset pulses: " << probes[0].rises << ", blue: " << std::to_string(board->blue)
+            << ", green: " << std::to_string(board->green) << ", red: " << std::to_string(board->red) << "\n";
+  checks(probes[0].rises == 1 && !root->ice40hx8k__DOT__reset);
+  checks(board->blue && !board->green && !board->red);
+  update_tests(checks, "EDIT after power-on reset", "Test 1: ");
+
+  /////////////////////////////////////////////////////////////
+  board->pb = 1 << TO_RAW;
+  cycle_hwclk(HWCLK_PER_HZ100);
+  board->pb = 0;
+  cycle_hwclk(HWCLK_PER_HZ100);
+  std::cout << "\nTest 2: Pressing W should take us to RAW mode (red = 1)." << "\n";
+  std::cout << "blue: " << std::to_string(board->blue) << ", green: " << std::to_string(board->green)
+            << ", red: " << std::to_string(board->red) << "\n";
+  update_tests(!board->blue && !board->green && board->red, 1, "RAW after W", "Test 2: ");
+
+  /////////////////////////////////////////////////////////////
+  // Each derived clock measured over three hz100 periods against what the
+  // wrapper means it to be; serclk should be near 2 * 16 * 115200.
+  struct Rate {
+    const char* name;
+    double nominal;
+    double tolerance_ppm;
+  };
+  static const Rate rates[] = {{"hz2m", 2000000, 100}, {"hz100", 100, 100}, {"serclk", 2 * 16 * BAUD, 2000}};
+  const CData* signals[] = {&root->ice40hx8k__DOT__hz2m, &root->ice40hx8k__DOT__hz100, &root->ice40hx8k__DOT__serclk};
+  probes.clear();
+  for (const CData* s : signals)
+    probes.push_back({s, *s, 0, 0, 0});
+  cycle_hwclk(HWCLK_PER_HZ100 * 3 + HWCLK_PER_HZ2M);
+  std::cout << "\nTest 3: The derived clocks should run at their intended rates." << "\n";
+  for (int i = 0; i < 3; i++) {
+    const Probe& p = probes[i];
+    bool measured = p.rises > 1;
+    double period = measured ? double(p.latest - p.first) / (p.rises - 1) : 0;
+    double hz = measured ? TIME_HZ / period : 0;
+    double ppm = (hz / rates[i].nominal - 1) * 1e6;
+    printf("%-7s %14.3f Hz  hwclk / %-10.3f %+9.1f ppm of %.0f Hz\n", rates[i].name, hz, period / 2, ppm,
+           rates[i].nominal);
+    checks(measured && std::fabs(ppm) <= rates[i].tolerance_ppm);
+  }
+  probes.clear();
+  update_tests(checks, "clock rates", "Test 3: ");
+
+  /////////////////////////////////////////////////////////////
+  // The UART samples Rx with serclk / 32, so the PLL ratio decides
+  // whether bytes sent at the nominal rate arrive intact.
+  std::cout << "\nTest 4: Bytes sent to Rx at 115200 baud should arrive on the UART." << "\n";
+  for (char c : rx) {
+    send_byte(board, c);
+    uint8_t got = root->ice40hx8k__DOT__rxdata;
+    if (!checks(got == (uint8_t)c))
+      std::cout << "sent " << padbin((uint8_t)c, 8) << ", received " << padbin(got, 8) << "\n";
+  }
+  update_tests(checks, "UART receive of \"" + rx + "\"", "Test 4: ");
+
+  int result = report_tests();
+
+  uint64_t cycles = clocks->rises(hwclk_clock), evals = clocks->evals();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  printf("bench ice40hx8k workload=board trace=0 cycles=%llu seconds=%.3f cycles_per_sec=%.0f ns_per_eval=%.2f\n",
+         (unsigned long long)cycles, seconds, cycles / seconds, seconds * 1e9 / evals);
+
+  board->final();
+  write_coverage(contextp.get());
+  delete clocks;
+  clocks = NULL;
+  delete board;
+  board = NULL;
+  return result;
+}
@@ -0,0 +1,216 @@
+// Loader for the $readmemh images in audio/ (kick.mem, clap.mem, ...).
+//
+// load_mem() maps the file, parses it with a table-driven fast path for
+// the usual one-byte-per-line layout, and checks that it fits the ROM.
+// The parsed bytes are cached in a binary sidecar (<file>.bin) stamped
+// with the source's size and mtime, so later runs only map the sidecar.
+//
+// Besides "xx\n" lines, the slow path accepts what $readmemh does:
+// any whitespace, // comments, @address directives and _ separators.
+// load_mem_words() reads memories wider than 8 bits the same way.
+//======================================================================
+#ifndef DRUM_MACHINE_MEM_IMAGE_H
+#define DRUM_MACHINE_MEM_IMAGE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace mem_image {
+
+struct HexTable {
+  int8_t v[256];
+  HexTable() {
+    memset(v, -1, sizeof(v));
+    for (int c = 0; c < 10; c++)
+      v['0' + c] = c;
+    for (int c = 0; c < 6; c++)
+      v['a' + c] = v['A' + c] = 10 + c;
+  }
+};
+static const HexTable hex;
+
+// Sidecar layout: header, then count words of image.
+struct SidecarHeader {
+  char magic[8];  // "MEMIMG1\0"
+  uint64_t word_size;
+  uint64_t source_size;
+  int64_t source_mtime_ns;
+  uint64_t count;
+};
+
+[[noreturn]] inline void fail(const std::string& path, const std::string& why) {
+  printf("Fatal error: %s: %s\n", path.c_str(), why.c_str());
+  exit(1);
+}
+
+// A read-only mapping of a whole file.
+struct Mapping {
+  const uint8_t* data = NULL;
+  size_t size = 0;
+  struct stat st;
+
+  explicit Mapping(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        data = (const uint8_t*)p;
+        size = st.st_size;
+      }
+    }
+    close(fd);
+  }
+  ~Mapping() {
+    if (data)
+      munmap((void*)data, size);
+  }
+  bool ok() const { return data != NULL; }
+};
+
+inline int64_t mtime_ns(const struct stat& st) {
+  return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+template <class Word>
+bool read_sidecar(const std::string& path, const struct stat& src, std::vector<Word>& out) {
+  Mapping m(path + ".bin");
+  if (!m.ok() || m.size < sizeof(SidecarHeader))
+    return false;
+  SidecarHeader h;
+  memcpy(&h, m.data, sizeof(h));
+  if (memcmp(h.magic, "MEMIMG1", 8) || h.word_size != sizeof(Word) || h.source_size != uint64_t(src.st_size) ||
+      h.source_mtime_ns != mtime_ns(src) || h.count * sizeof(Word) != m.size - sizeof(h))
+    return false;
+  out.resize(h.count);
+  memcpy(out.data(), m.data + sizeof(h), h.count * sizeof(Word));
+  return true;
+}
+
+// Best effort: a read-only checkout just parses every time.
+template <class Word>
+void write_sidecar(const std::string& path, const struct stat& src, const std::vector<Word>& image) {
+  SidecarHeader h;
+  memcpy(h.magic, "MEMIMG1", 8);
+  h.word_size = sizeof(Word);
+  h.source_size = src.st_size;
+  h.source_mtime_ns = mtime_ns(src);
+  h.count = image.size();
+  std::string tmp = path + ".bin." + std::to_string(getpid());
+  FILE* f = fopen(tmp.c_str(), "wb");
+  if (!f)
+    return;
+  bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(image.data(), sizeof(Word), image.size(), f) == image.size();
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), (path + ".bin").c_str()) != 0)
+    unlink(tmp.c_str());
+}
+
+inline void too_big(const std::string& path, size_t depth) {
+  fail(path, "does not fit a " + std::to_string(depth) + "-word ROM");
+}
+
+// Stores v at addr and moves on to the next word.
+template <class Word>
+void put(std::vector<Word>& out, size_t& addr, Word v) {
+  if (addr < out.size())
+    out[addr] = v;
+  else {
+    out.resize(addr);
+    out.push_back(v);
+  }
+  addr++;
+}
+
+template <class Word>
+void parse(const std::string& path, const uint8_t* p, const uint8_t* end, size_t depth, std::vector<Word>& out) {
+  out.reserve(std::min<size_t>((end - p) / 3 + 1, depth));
+  size_t addr = 0;
+  while (p < end) {
+    // Fast path: two hex digits and a newline.
+    if (sizeof(Word) == 1 && end - p >= 3 && p[2] == '\n') {
+      int hi = hex.v[p[0]], lo = hex.v[p[1]];
+      if ((hi | lo) >= 0) {
+        if (addr >= depth)
+          too_big(path, depth);
+        put(out, addr, Word(hi << 4 | lo));
+        p += 3;
+        continue;
+      }
+    }
+    // Slow path: one token, comment or directive.
+    uint8_t c = *p;
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      p++;
+    }
+    else if (c == '/' && end - p >= 2 && p[1] == '/') {
+      while (p < end && *p != '\n')
+        p++;
+    }
+    else if (c == '@' || hex.v[c] >= 0) {
+      bool at = c == '@';
+      p += at;
+      uint64_t v = 0;
+      const uint8_t* start = p;
+      for (; p < end && (hex.v[*p] >= 0 || *p == '_'); p++)
+        if (*p != '_')
+          v = v << 4 | hex.v[*p];
+      if (p == start || (!at && v > Word(~Word(0))))
+        fail(path, at ? "bad @address" : "value wider than " + std::to_string(8 * sizeof(Word)) + " bits");
+      if (at) {
+        addr = v;
+        continue;
+      }
+      if (addr >= depth)
+        too_big(path, depth);
+      put(out, addr, Word(v));
+    }
+    else {
+      fail(path, std::string("unexpected character '") + char(c) + "'");
+    }
+  }
+}
+
+} // namespace mem_image
+
+// The image in path, one entry per ROM word from address 0, at most depth
+// entries long.  Exits with a message if it is missing or malformed.
+template <class Word>
+std::vector<Word> load_mem_words(const std::string& path, size_t depth) {
+  using namespace mem_image;
+  std::vector<Word> image;
+  Mapping m(path);
+  struct stat st;
+  if (!m.ok()) {
+    if (stat(path.c_str(), &st) != 0)
+      fail(path, "cannot open");
+    // an empty image is legal
+  }
+  else {
+    st = m.st;
+    if (!read_sidecar(path, st, image)) {
+      parse(path, m.data, m.data + m.size, depth, image);
+      write_sidecar(path, st, image);
+    }
+  }
+  if (image.size() > depth)
+    too_big(path, depth);
+  return image;
+}
+
+inline std::vector<uint8_t> load_mem(const std::string& path, size_t depth) {
+  return load_mem_words<uint8_t>(path, depth);
+}
+
+#endif
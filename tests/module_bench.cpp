@@ -0,0 +1,207 @@
+// DESCRIPTION: Verilator: Verilog example module
+//
+// This file ONLY is placed under the Creative Commons Public Domain, for
+// any use, without warranty, 2017 by Wilson Snyder.
+// SPDX-License-Identifier: CC0-1.0
+//======================================================================
+// Simulation speed benchmark for the module models.
+//
+// Built once per module with -DBENCH_<module> (see the bench target) and
+// run with each workload that module has:
+//
+//   idle    inputs held, only the clock moves
+//   keys    the inputs a user drives change every few cycles
+//   audio   the sample/pwm path running as it does during playback
+//
+// and prints, per workload, simulated clock cycles per second and ns per
+// eval() in the same "bench ..." line format as top_bench.
+//
+//   +cycles=N      cycles per workload (default 10000000)
+//   +workload=W    run only workload W
+//   +trace         dump every edge to <module>_bench.fst while timing
+//======================================================================
+// Include common routines
+#include <verilated.h>
+#include "verilated_fst_c.h"
+
+// Shared harness: clocking, checks and reporting
+#include "testbench.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+enum Workload { IDLE, KEYS, AUDIO };
+static const char* WORKLOAD_NAMES[] = {"idle", "keys", "audio"};
+
+// Per module: the model, its clock (NULL if combinational), which
+// workloads apply, and the inputs for cycle i of each.
+#if defined(BENCH_scankey)
+#include "Vscankey.h"
+typedef Vscankey Model;
+#define BENCH_NAME "scankey"
+static const bool has[] = {true, true, false};
+static void stimulus(Model* m, Workload w, uint64_t i) {
+  m->in = w == KEYS && (i >> 4 & 1) ? 1u << (i >> 5) % 20 : 0;
+}
+#elif defined(BENCH_clkdiv)
+#include "Vclkdiv.h"
+typedef Vclkdiv Model;
+#define BENCH_NAME "clkdiv"
+static const bool has[] = {true, true, true};
+static void stimulus(Model* m, Workload w, uint64_t i) {
+  m->lim = w == IDLE ? 255 : w == KEYS ? (i >> 10) & 0xff : 127;
+}
+#elif defined(BENCH_prienc8to3)
+#include "Vprienc8to3.h"
+typedef Vprienc8to3 Model;
+#define BENCH_NAME "prienc8to3"
+#define BENCH_COMBINATIONAL
+static const bool has[] = {true, true, false};
+static void stimulus(Model* m, Workload w, uint64_t i) {
+  m->in = w == KEYS ? i & 0xff : 0x80;
+}
+#elif defined(BENCH_sequencer)
+#include "Vsequencer.h"
+typedef Vsequencer Model;
+#define BENCH_NAME "sequencer"
+static const bool has[] = {true, true, true};
+static void stimulus(Model* m, Workload w, uint64_t i) {
+  m->go_right = w == AUDIO || (w == KEYS && (i & 3) == 1);
+  m->go_left = w == KEYS && (i & 3) == 3;
+}
+#elif defined(BENCH_sequence_editor)
+#include "Vsequence_editor.h"
+typedef Vsequence_editor Model;
+#define BENCH_NAME "sequence_editor"
+static const bool has[] = {true, true, false};
+static void stimulus(Model* m, Workload w, uint64_t i) {
+  m->mode = w == KEYS ? 0 : 1;
+  m->set_time_idx = i & 7;
+  m->tgl_play_smpl = w == KEYS ? (i >> 3) & 0xf : 0;
+}
+#elif defined(BENCH_pwm)
+#include "Vpwm.h"
+typedef Vpwm Model;
+#define BENCH_NAME "pwm"
+static const bool has[] = {true, false, true};
+static void stimulus(Model* m, Workload w, uint64_t i) {
+  m->enable = w == AUDIO;
+  m->duty_cycle = (i >> 8) * 37;
+}
+#elif defined(BENCH_sample)
+#include "Vsample.h"
+typedef Vsample Model;
+#define BENCH_NAME "sample"
+static const bool has[] = {true, false, true};
+static void stimulus(Model* m, Workload w, uint64_t) {
+  m->enable = w == AUDIO;
+}
+#elif defined(BENCH_adpcm)
+#include "Vadpcm.h"
+typedef Vadpcm Model;
+#define BENCH_NAME "adpcm"
+static const bool has[] = {true, false, true};
+static void stimulus(Model* m, Workload w, uint64_t i) {
+  m->enable = w == AUDIO;
+  m->code = (i * 2654435761u) >> 28;
+}
+#elif defined(BENCH_controller)
+#include "Vcontroller.h"
+typedef Vcontroller Model;
+#define BENCH_NAME "controller"
+static const bool has[] = {true, true, false};
+static void stimulus(Model* m, Workload w, uint64_t i) {
+  unsigned k = w == KEYS ? (i >> 2) % 4 : 3;
+  m->set_edit = k == 0;
+  m->set_play = k == 1;
+  m->set_raw = k == 2;
+}
+#else
+#error "build with -DBENCH_<module>"
+#endif
+
+struct FstHook {
+  VerilatedFstC* tfp;
+  inline void operator()(uint64_t time) {
+    if (tfp)
+      tfp->dump(time);
+  }
+};
+
+// Times cycles of workload w on a fresh model and prints the result.
+static void bench(Workload w, uint64_t cycles, bool traced) {
+  VerilatedContext context;
+  context.randReset(2);
+  context.traceEverOn(true);
+  Model* m = new Model(&context);
+  VerilatedFstC tfp;
+  if (traced) {
+    m->trace(&tfp, 99);
+    tfp.open((std::string(BENCH_NAME) + "_bench.fst").c_str());
+  }
+  FstHook hook = {traced ? &tfp : NULL};
+
+#ifdef BENCH_COMBINATIONAL
+  const int evals_per_cycle = 1;
+  m->eval();
+#else
+  const int evals_per_cycle = 2;
+  ClockDriver<Model, FstHook> clock(m, m->clk, &context, hook);
+  m->clk = 0;
+  m->rst = 1;
+  stimulus(m, w, 0);
+  clock.settle();
+  m->rst = 0;
+  clock.step(2);
+#endif
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < cycles; i++) {
+    stimulus(m, w, i);
+#ifdef BENCH_COMBINATIONAL
+    m->eval();
+    context.timeInc(1);
+    hook(context.time());
+#else
+    clock.step();
+#endif
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("bench %s workload=%s trace=%d cycles=%llu seconds=%.3f cycles_per_sec=%.0f ns_per_eval=%.2f\n", BENCH_NAME,
+         WORKLOAD_NAMES[w], traced ? 1 : 0, (unsigned long long)cycles, seconds, cycles / seconds,
+         seconds * 1e9 / (cycles * evals_per_cycle));
+  if (traced)
+    tfp.close();
+  m->final();
+  delete m;
+}
+
+int main(int argc, char **argv, char **env)
+{
+  // Prevent unused variable warnings
+  if (0 && argc && argv && env) {}
+
+  Verilated::debug(0);
+  Verilated::commandArgs(argc, argv);
+
+  uint64_t cycles = 10000000;
+  std::string only;
+  bool traced = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (!arg.compare(0, 8, "+cycles="))
+      cycles = std::strtoull(arg.c_str() + 8, NULL, 0);
+    else if (!arg.compare(0, 10, "+workload="))
+      only = arg.substr(10);
+    else if (arg == "+trace")
+      traced = true;
+  }
+
+  for (int w = IDLE; w <= AUDIO; w++)
+    if (has[w] && (only.empty() || only == WORKLOAD_NAMES[w]))
+      bench(Workload(w), cycles, traced);
+  return 0;
+}
@@ -7,66 +7,16 @@
 // Include common routines
 #include <verilated.h>
 
-static int passed_test_count = 0; // every time we perform a test, and the test passes, increment this by one.
-static int total_test_count = 0;  // every time we perform a test, increment this by one.
+// Shared harness: clocking, checks and reporting
+#include "testbench.h"
 
 // Include model header, generated from Verilating "tb_top.v"
 #include "Vprienc8to3.h"
 
-// Verilator using new C++?  Need to include these now (sstep2021)
-#include <iostream>
-using namespace std;
+// Expected outputs, built at compile time
+#include "ref_tables.h"
 
-// Current simulation time (64-bit unsigned)
-vluint64_t main_time = 0;
-// Called by $time in Verilog
-double sc_time_stamp()
-{
-  return main_time; // Note does conversion to real, to match SystemC
-}
-
-int concat(int w, int a, int b)
-{
-  return (a << w) | b;
-}
-
-std::string bin(int b)
-{
-  std::string ans;
-  while (b != 0)
-  {
-    ans += b % 2 == 0 ? "0" : "1";
-    b /= 2;
-  }
-  std::reverse(ans.begin(), ans.end());
-  return ans;
-}
-
-int pin(int a, int b) {
-  return (a >> b) & 1;
-}
-
-void update_tests(int passed, int total, std::string test) {
-  // add tests to global test variables
-  passed_test_count += passed;
-  total_test_count += total;
-  // perform sanity check on global test variables
-  assert(passed_test_count <= total_test_count);
-  // let TA know if this set of tests failed
-  std::cout << "Part " << test << ": " << std::to_string(passed) << " out of " << std::to_string(total) << " tests passed.\n";
-}
-
-int retval(int inp) {
-  int i = 0x80;
-  int idx = 7;
-  while (i != 0) {
-    if (inp & i)
-      return idx;
-    i >>= 1;
-    idx--;
-  }
-  return 0;
-}
+static constexpr std::array<uint8_t, 256> expected = ref_table<uint8_t, 256>(prienc8to3_ref);
 
 int main(int argc, char **argv, char **env)
 {
@@ -93,8 +43,7 @@ int main(int argc, char **argv, char **env)
   // Construct the Verilated model, from each module after Verilating each module file
   Vprienc8to3 *prienc8to3 = new Vprienc8to3; // Or use a const unique_ptr, or the VL_UNIQUE_PTR wrapper
 
-  int passed_subtests = 0; // if we have multiple subtests, we need to know how many passed for each
-  int total_subtests = 0;
+  Checks checks; // if we have multiple subtests, we need to know how many passed for each
 
   /*************************************************************************/
   // BEGIN TESTS
@@ -111,43 +60,27 @@ int main(int argc, char **argv, char **env)
   for (int i = 0; i <= 0xFF; i++) {
     prienc8to3->in = i;
     prienc8to3->eval();
-    if (prienc8to3->out == retval(prienc8to3->in))
-        passed_subtests++;
-    else
-        std::cout << "prienc8to3 failed on input " << bin(prienc8to3->in) << " with output " << bin(prienc8to3->out) << ", expected output was " << bin(retval(prienc8to3->in)) << "\n";
-    total_subtests++;
+    if (!checks(prienc8to3->out == expected[i]))
+        std::cout << "prienc8to3 failed on input " << bin(prienc8to3->in) << " with output " << bin(prienc8to3->out) << ", expected output was " << bin(expected[i]) << "\n";
   }
 
-  update_tests(passed_subtests, total_subtests, "1");
+  update_tests(checks, "1");
   /***********************************/
 
-  passed_subtests = 0;
-  total_subtests = 0;
-
   /***********************************/
   // END TESTS
   /*************************************************************************/
 
-  // good to have to detect bugs
-  assert(passed_test_count <= total_test_count);
-
-  if (passed_test_count == total_test_count)
-  {
-    std::cout << "ALL " << std::to_string(total_test_count) << " TESTS PASSED"
-              << "\n";
-  }
-  else
-  {
-    std::cout << "ERROR: " << std::to_string(passed_test_count) << "/" << std::to_string(total_test_count) << " tests passed.\n";
-  }
+  int result = report_tests();
 
   // Final model cleanups
   prienc8to3->final();
+  write_coverage();
 
   // Destroy models
   delete prienc8to3;
   prienc8to3 = NULL;
 
   // Fin
-  return passed_test_count == total_test_count ? 0 : 1;
+  return result;
 }
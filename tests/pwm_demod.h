@@ -0,0 +1,220 @@
+// PWM-to-PCM demodulator for the top testbench.
+//
+// record_audio() used to branch on right[0] every hz2m cycle and store the
+// count of ones per 256-cycle window in a byte, which wrapped to 0 at full
+// scale.  Now each cycle appends one bit to a packed buffer with a shift
+// and an OR, and decode() turns whole words at a time into signed 16-bit
+// PCM with popcounts.
+//
+//   +demod=box         ones per window (default)
+//   +demod=moving      boxcar over the last +demod_span cycles, stepped by
+//                      one window; span must be a multiple of the window
+//   +demod=fir         Hann-weighted FIR over the last +demod_span cycles,
+//                      stepped by one window; window and span must be
+//                      multiples of 64
+//   +demod_window=N    hz2m cycles per output sample (default 256, i.e.
+//                      7812.5 Hz for the 2 MHz hz2m of the board; see
+//                      HZ2M in top_harness.h)
+//   +demod_span=N      filter length for moving/fir (default 4 windows)
+//
+// Filters are causal, so a sample is ready as soon as its window is, and
+// normalised to the bits actually seen so the first samples are not
+// pulled towards silence.  All-zero maps to -32768, all-one to 32767.
+//======================================================================
+#ifndef DRUM_MACHINE_PWM_DEMOD_H
+#define DRUM_MACHINE_PWM_DEMOD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Ones in n packed words.  Windows are a few words long, so a plain
+// popcount per word is all this needs.
+inline uint64_t popcount_words(const uint64_t* w, size_t n) {
+  uint64_t total = 0;
+  for (size_t i = 0; i < n; i++)
+    total += __builtin_popcountll(w[i]);
+  return total;
+}
+
+class PwmDemod {
+public:
+  enum Mode { BOX, MOVING, FIR };
+
+  PwmDemod(unsigned window = 256, Mode mode = BOX, unsigned span = 0) { configure(window, mode, span); }
+
+  // Reads the +demod* plusargs described above.
+  PwmDemod(int argc, char** argv) {
+    unsigned window = 256, span = 0;
+    Mode mode = BOX;
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "+demod=box")
+        mode = BOX;
+      else if (arg == "+demod=moving")
+        mode = MOVING;
+      else if (arg == "+demod=fir")
+        mode = FIR;
+      else if (!arg.compare(0, 7, "+demod="))
+        fail("unknown +demod mode (expected box, moving or fir)");
+      else if (!arg.compare(0, 14, "+demod_window="))
+        window = std::strtoul(arg.c_str() + 14, NULL, 0);
+      else if (!arg.compare(0, 12, "+demod_span="))
+        span = std::strtoul(arg.c_str() + 12, NULL, 0);
+    }
+    configure(window, mode, span);
+  }
+
+  // Appends one cycle of PWM output.
+  inline void push(bool bit) {
+    size_t i = bits_ - base_;
+    if ((i & 63) == 0)
+      words_.push_back(0);
+    words_[i >> 6] |= uint64_t(bit) << (i & 63);
+    bits_++;
+  }
+
+  // Appends n <= 64 cycles at once, bit 0 of bits first.
+  inline void push_word(uint64_t bits, unsigned n) {
+    if (n < 64)
+      bits &= (1ull << n) - 1;
+    size_t i = bits_ - base_;
+    unsigned off = i & 63;
+    if (off == 0)
+      words_.push_back(bits);
+    else {
+      words_.back() |= bits << off;
+      if (off + n > 64)
+        words_.push_back(bits >> (64 - off));
+    }
+    bits_ += n;
+  }
+
+  // Appends every sample whose window is complete to out and returns how
+  // many were added.
+  size_t decode(std::vector<int16_t>& out) {
+    size_t added = 0;
+    while (bits_ - next_ >= window_) {
+      out.push_back(sample());
+      next_ += window_;
+      added++;
+    }
+    // Keep only the words a later sample can still reach.
+    uint64_t keep = next_;
+    if (mode_ == FIR)
+      keep = next_ + window_ > span_ ? next_ + window_ - span_ : 0;
+    size_t drop = (keep - base_) >> 6;
+    if (drop) {
+      words_.erase(words_.begin(), words_.begin() + drop);
+      base_ += drop * 64;
+    }
+    return added;
+  }
+
+  // Forgets all captured bits, e.g. between recordings.
+  void reset() {
+    words_.clear();
+    base_ = bits_ = next_ = 0;
+    std::fill(boxes_.begin(), boxes_.end(), 0);
+    moving_ = 0;
+  }
+
+  unsigned window() const { return window_; }
+
+private:
+  static void fail(const char* why) {
+    printf("pwm_demod: %s\n", why);
+    exit(EXIT_FAILURE);
+  }
+
+  void configure(unsigned window, Mode mode, unsigned span) {
+    if (!window)
+      fail("+demod_window must be positive");
+    window_ = window;
+    mode_ = mode;
+    span_ = mode == BOX ? window : span ? span : 4 * window;
+    if (span_ < window_ || span_ % window_)
+      fail("+demod_span must be a multiple of +demod_window");
+    if (mode == MOVING)
+      boxes_.assign(span_ / window_, 0);
+    if (mode == FIR) {
+      if (window_ % 64 || span_ % 64)
+        fail("+demod=fir needs +demod_window and +demod_span to be multiples of 64");
+      // Hann taps at one per 64-cycle word, oldest first.
+      size_t n = span_ / 64;
+      taps_.resize(n);
+      for (size_t j = 0; j < n; j++)
+        taps_[j] = uint32_t(0.5 + 65535.0 * std::sin(M_PI * (j + 0.5) / n) * std::sin(M_PI * (j + 0.5) / n));
+    }
+  }
+
+  // Ones in absolute bits [begin, end).
+  uint64_t ones(uint64_t begin, uint64_t end) const {
+    begin -= base_;
+    end -= base_;
+    size_t first = begin >> 6, last = end >> 6;
+    uint64_t head = ~0ull << (begin & 63);
+    if (first == last)
+      return __builtin_popcountll(words_[first] & head & ((1ull << (end & 63)) - 1));
+    uint64_t n = __builtin_popcountll(words_[first] & head) + popcount_words(words_.data() + first + 1, last - first - 1);
+    if (end & 63)
+      n += __builtin_popcountll(words_[last] & ((1ull << (end & 63)) - 1));
+    return n;
+  }
+
+  // Maps a fraction ones/total to signed 16-bit PCM.
+  static int16_t pcm(uint64_t ones, uint64_t total) {
+    int64_t v = int64_t((ones << 16) / total) - 32768;
+    return int16_t(v > 32767 ? 32767 : v);
+  }
+
+  // The sample for window [next_, next_ + window_).
+  int16_t sample() {
+    uint64_t end = next_ + window_;
+    switch (mode_) {
+      case BOX:
+        return pcm(ones(next_, end), window_);
+      case MOVING: {
+        // Running sum over the last span/window box counts.
+        uint64_t box = ones(next_, end);
+        size_t slot = (next_ / window_) % boxes_.size();
+        moving_ += box - boxes_[slot];
+        boxes_[slot] = box;
+        uint64_t seen = end < span_ ? end : span_;
+        return pcm(moving_, seen);
+      }
+      case FIR: {
+        size_t n = taps_.size();
+        size_t skip = end < span_ ? (span_ - end) / 64 : 0;
+        const uint64_t* w = &words_[(end - base_) / 64 - (n - skip)];
+        uint64_t acc = 0, gain = 0;
+        for (size_t j = skip; j < n; j++) {
+          acc += uint64_t(taps_[j]) * __builtin_popcountll(w[j - skip]);
+          gain += taps_[j];
+        }
+        return pcm(acc, gain * 64);
+      }
+    }
+    return 0;
+  }
+
+  unsigned window_ = 256, span_ = 256;
+  Mode mode_ = BOX;
+
+  // Packed bits; words_[0] bit 0 is absolute cycle base_.
+  std::vector<uint64_t> words_;
+  uint64_t base_ = 0, bits_ = 0;
+  // Start of the next sample's window.
+  uint64_t next_ = 0;
+
+  std::vector<uint64_t> boxes_;
+  uint64_t moving_ = 0;
+
+  std::vector<uint32_t> taps_;
+};
+
+#endif
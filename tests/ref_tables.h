@@ -0,0 +1,53 @@
+// Expected-value tables for the combinational module tests.
+//
+// The reference functions below are the specification of each block's
+// output; ref_table() evaluates one over the whole input space once, so
+// a test's checking loop is a single lookup and compare and the time it
+// measures is the model's.  Tables small enough for the compiler's
+// constexpr limits (prienc8to3's 256 entries) are built at compile time;
+// scankey's 2^20 entries are built at startup, which takes a few
+// milliseconds.  top_model.h uses the same functions.
+//======================================================================
+#ifndef DRUM_MACHINE_REF_TABLES_H
+#define DRUM_MACHINE_REF_TABLES_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// scankey out: the index of the pressed key among in[19:0], i.e. bit b
+// of out is the OR of every in[k] with bit b of k set.
+constexpr uint8_t scankey_ref(uint32_t in) {
+  return uint8_t(((in & 0xaaaaa) != 0) | ((in & 0xccccc) != 0) << 1 | ((in & 0x0f0f0) != 0) << 2 |
+                 ((in & 0x0ff00) != 0) << 3 | ((in & 0xf0000) != 0) << 4);
+}
+
+// prienc8to3 out: the index of the highest set bit of in, 0 if none.
+constexpr uint8_t prienc8to3_ref(uint32_t in) {
+  uint8_t idx = 0;
+  for (uint8_t i = 1; i < 8; i++)
+    if (in >> i & 1)
+      idx = i;
+  return idx;
+}
+
+// Every output of fn for inputs 0..N-1, at compile time.
+template <class Out, size_t N, class Fn>
+constexpr std::array<Out, N> ref_table(Fn fn) {
+  std::array<Out, N> t{};
+  for (size_t i = 0; i < N; i++)
+    t[i] = Out(fn(uint32_t(i)));
+  return t;
+}
+
+// The same at run time, for tables past the constexpr limits.
+template <class Out, class Fn>
+std::vector<Out> ref_table(size_t n, Fn fn) {
+  std::vector<Out> t(n);
+  for (size_t i = 0; i < n; i++)
+    t[i] = Out(fn(uint32_t(i)));
+  return t;
+}
+
+#endif
@@ -0,0 +1,117 @@
+// Checks tools/samplebank against the images it packs.
+//
+// Packs the four drums from audio/ into one bank and reads it back with
+// load_sample_bank() (sample_bank.h): every voice must start where the
+// one before it ends, be as long as its source .mem, hold the same
+// samples, and appear with the same start and length in _index.svh.
+// Then packs voices whose names are not identifiers, which must come out
+// as valid localparam names, and two names that clash once cleaned up,
+// which must be refused.
+//
+// No Verilated model is involved; make bank_test builds this and the
+// tool with the C++ compiler alone.
+//
+//   sample_bank <samplebank> <audio dir> <scratch dir>
+//======================================================================
+#include "sample_bank.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+  printf("%s: %s\n", ok ? "pass" : "FAIL", what.c_str());
+  failures += !ok;
+}
+
+static std::string read_file(const std::string& path) {
+  std::ifstream f(path);
+  std::stringstream s;
+  s << f.rdbuf();
+  return s.str();
+}
+
+// Runs samplebank -o base with inputs; true if it succeeded.
+static bool pack(const std::string& tool, const std::string& base, const std::string& inputs) {
+  std::string cmd = tool + " -o " + base + " " + inputs + " >/dev/null 2>&1";
+  return system(cmd.c_str()) == 0;
+}
+
+// Whether every localparam in svh is named with a plain identifier.
+static bool identifiers_ok(const std::string& svh) {
+  std::istringstream lines(svh);
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (line.compare(0, 11, "localparam "))
+      continue;
+    for (size_t p = line.find(" = "); p != std::string::npos; p = line.find(" = ", p + 3)) {
+      size_t begin = line.rfind(' ', p - 1) + 1;
+      std::string id = line.substr(begin, p - begin);
+      if (id.empty() || isdigit((unsigned char)id[0]))
+        return false;
+      for (char c : id)
+        if (!isalnum((unsigned char)c) && c != '_')
+          return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 4) {
+    printf("usage: sample_bank <samplebank> <audio dir> <scratch dir>\n");
+    exit(EXIT_FAILURE);
+  }
+  std::string tool = argv[1], audio = argv[2], scratch = argv[3];
+  const char* drums[] = {"kick", "clap", "hihat", "snare"};
+
+  std::string inputs;
+  for (const char* d : drums)
+    inputs += std::string(d) + "=" + audio + "/" + d + ".mem ";
+  std::string base = scratch + "/drums";
+  check(pack(tool, base, inputs), "samplebank packs the four drums");
+
+  SampleBank bank = load_sample_bank(base);
+  std::string svh = read_file(base + "_index.svh");
+  check(bank.voices.size() == 4, "four voices in the index");
+  uint32_t next = 0;
+  for (size_t v = 0; v < 4 && v < bank.voices.size(); v++) {
+    std::vector<uint8_t> src = load_mem(audio + "/" + drums[v] + ".mem", BANK_MAX_DEPTH);
+    const SampleBank::Voice& voice = bank.voices[v];
+    std::vector<int8_t> samples = bank.samples(v, false);
+    std::string name = drums[v];
+    check(voice.start == next, name + " starts where the voice before it ends");
+    check(voice.length == src.size(), name + " is as long as " + name + ".mem");
+    check(std::vector<uint8_t>(samples.begin(), samples.end()) == src, name + " holds the samples of " + name + ".mem");
+    for (char& c : name)
+      c = toupper((unsigned char)c);
+    std::string param = name + "_START = 16'd" + std::to_string(voice.start) + ", " + name + "_LEN = 16'd" +
+                        std::to_string(voice.length) + ";";
+    check(svh.find(param) != std::string::npos, name + " has the same start and length in _index.svh");
+    if (voice.start != next || voice.length != src.size())
+      printf("start %u, length %u; expected start %u, length %zu\n", voice.start, voice.length, next, src.size());
+    next = voice.start + voice.length;
+  }
+  check(bank.rom.size() % BANK_BRAM_BYTES == 0 && bank.rom.size() - next < BANK_BRAM_BYTES,
+        "padded only up to the next block RAM");
+
+  base = scratch + "/names";
+  check(pack(tool, base, "hi-hat=" + audio + "/hihat.mem 808kick=" + audio + "/kick.mem"),
+        "samplebank packs voices named hi-hat and 808kick");
+  svh = read_file(base + "_index.svh");
+  check(svh.find("HI_HAT_START") != std::string::npos && svh.find("_808KICK_START") != std::string::npos,
+        "they are named HI_HAT and _808KICK in _index.svh");
+  check(identifiers_ok(svh), "every localparam name is an identifier");
+
+  base = scratch + "/clash";
+  check(!pack(tool, base, "hi-hat=" + audio + "/hihat.mem hi.hat=" + audio + "/hihat.mem"),
+        "samplebank refuses hi-hat and hi.hat, both HI_HAT");
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,69 @@
+// Packed sample bank written by tools/samplebank.
+//
+// All voices share one 8-bit ROM image, <bank>.mem, packed back to back
+// and padded with silence only at the very end, up to a whole number of
+// iCE40 4 Kbit block RAMs (512 bytes each).  <bank>_index.mem holds one
+// 32-bit word per voice, {start[15:0], length[15:0]}, in the same
+// $readmemh format, so the RTL and the testbenches read the same table.
+// Samples are signed 8-bit, like the single-voice images in audio/, or
+// with --adpcm two 4-bit ADPCM codes per byte (see adpcm.h); start is then
+// a byte address and length still counts samples.
+//======================================================================
+#ifndef DRUM_MACHINE_SAMPLE_BANK_H
+#define DRUM_MACHINE_SAMPLE_BANK_H
+
+#include "adpcm.h"
+#include "mem_image.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Bytes in one iCE40 4 Kbit block RAM used 8 bits wide.
+static const size_t BANK_BRAM_BYTES = 512;
+// Largest image the 16-bit index can address.
+static const size_t BANK_MAX_DEPTH = 65536;
+
+struct SampleBank {
+  struct Voice {
+    uint32_t start;
+    uint32_t length;
+  };
+
+  std::vector<uint8_t> rom;
+  std::vector<Voice> voices;
+
+  size_t brams() const { return rom.size() / BANK_BRAM_BYTES; }
+
+  // Sample i of voice v as a signed value, for a raw bank.
+  int8_t at(size_t v, size_t i) const { return int8_t(rom[voices[v].start + i]); }
+
+  // All of voice v, decoding it first if the bank is ADPCM.
+  std::vector<int8_t> samples(size_t v, bool adpcm) const {
+    const uint8_t* p = rom.data() + voices[v].start;
+    if (!adpcm)
+      return std::vector<int8_t>(p, p + voices[v].length);
+    return adpcm_decode(std::vector<uint8_t>(p, p + (voices[v].length + 1) / 2), voices[v].length);
+  }
+
+  static uint32_t pack(const Voice& v) { return v.start << 16 | v.length; }
+  static Voice unpack(uint32_t w) { return Voice{w >> 16, w & 0xffff}; }
+};
+
+// Reads <base>.mem and <base>_index.mem.  Exits with a message if either
+// is missing or an index entry points outside the ROM.
+inline SampleBank load_sample_bank(const std::string& base) {
+  SampleBank bank;
+  bank.rom = load_mem(base + ".mem", BANK_MAX_DEPTH);
+  for (uint32_t w : load_mem_words<uint32_t>(base + "_index.mem", BANK_MAX_DEPTH)) {
+    SampleBank::Voice v = SampleBank::unpack(w);
+    // the index does not say whether the bank is ADPCM, so this only
+    // checks the smaller, ADPCM size
+    if (v.start + (v.length + 1) / 2 > bank.rom.size())
+      mem_image::fail(base + "_index.mem", "voice " + std::to_string(bank.voices.size()) + " runs past the ROM");
+    bank.voices.push_back(v);
+  }
+  return bank;
+}
+
+#endif
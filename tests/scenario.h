@@ -0,0 +1,212 @@
+// Scripted stimulus for top: scenario files parsed into a timed event
+// queue.
+//
+// A scenario is a text file with one command per line, each at a time in
+// hz2m cycles since power-on:
+//
+//   # comment                  (also after a command)
+//   @T  command ...            at time T
+//   +T  command ...            T after the previous line
+//       command ...            at the same time as the previous line
+//   @T or +T alone             nothing happens, but the run lasts until T
+//
+// T is a number of hz2m cycles, or with a p suffix of hz100 periods
+// (2 * MOD_M cycles), e.g. +2p.  Lines may come in any time order; events
+// at the same time happen in file order.
+//
+//   press KEY...          hold these keys, as well as any already held
+//   release KEY...        let go of these keys; "release all" for every key
+//   reset N               assert reset for N hz2m cycles
+//   capture NAME N        record N samples of right[0] to NAME.wav; the
+//                         lines after it count from the capture's end
+//   expect mode M         check the lamps show mode M: edit, play or raw
+//   expect step N         check left shows step N of the sequencer, 0 to
+//                         7 from the left, so step 0 is left[7]
+//
+// KEY is a key of the keypad, 0-9, a-f, w, x, y or z (pb[0] to pb[19]),
+// pbN, or one of the names
+//
+//   kick clap hihat snare   pb[3] pb[2] pb[1] pb[0]
+//   edit play raw           pb[19] pb[18] pb[16]
+//   left right              pb[11] pb[8]
+//
+// parse_scenario() reads a file once into a vector of events sorted by
+// time, so a runner can step straight from one event to the next.
+// Mistakes stop the run with file:line and what was wrong.
+//======================================================================
+#ifndef DRUM_MACHINE_SCENARIO_H
+#define DRUM_MACHINE_SCENARIO_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct ScenarioEvent {
+  enum Kind { WAIT, PRESS, RELEASE, RESET_ON, RESET_OFF, CAPTURE, EXPECT_MODE, EXPECT_STEP };
+
+  uint64_t cycle;
+  Kind kind;
+  uint32_t keys;     // PRESS, RELEASE
+  uint64_t count;    // CAPTURE: samples
+  unsigned value;    // EXPECT_MODE: 0 edit, 1 play, 2 raw; EXPECT_STEP: step
+  std::string name;  // CAPTURE: output file without .wav
+  int line;
+};
+
+// What a scenario's times are in: hz2m cycles per hz100 period and per
+// captured sample.
+struct ScenarioTiming {
+  uint64_t period;
+  uint64_t sample;
+};
+
+class ScenarioParser {
+public:
+  ScenarioParser(const std::string& file, ScenarioTiming timing) : file_(file), timing_(timing) {}
+
+  std::vector<ScenarioEvent> parse() {
+    std::ifstream in(file_);
+    if (!in)
+      fail("cannot be read");
+    std::string text;
+    while (std::getline(in, text)) {
+      line_++;
+      text = text.substr(0, text.find('#'));
+      std::istringstream words(text);
+      std::string word;
+      if (!(words >> word))
+        continue;
+      if (word[0] == '@')
+        now_ = time(word.substr(1));
+      else if (word[0] == '+')
+        now_ += time(word.substr(1));
+      else
+        words.seekg(0);
+      command(words);
+    }
+    std::stable_sort(events_.begin(), events_.end(),
+                     [](const ScenarioEvent& a, const ScenarioEvent& b) { return a.cycle < b.cycle; });
+    return events_;
+  }
+
+private:
+  void fail(const std::string& why) const {
+    printf("%s:%d: %s\n", file_.c_str(), line_, why.c_str());
+    exit(EXIT_FAILURE);
+  }
+
+  uint64_t number(const std::string& s) const {
+    char* end;
+    uint64_t n = std::strtoull(s.c_str(), &end, 10);
+    if (s.empty() || *end || !isdigit((unsigned char)s[0]))
+      fail("expected a number, not '" + s + "'");
+    return n;
+  }
+
+  uint64_t time(const std::string& s) const {
+    if (!s.empty() && s.back() == 'p')
+      return number(s.substr(0, s.size() - 1)) * timing_.period;
+    return number(s);
+  }
+
+  uint32_t key(std::string k) const {
+    std::transform(k.begin(), k.end(), k.begin(), ::tolower);
+    static const char* names[] = {"snare", "hihat", "clap", "kick", "right", "left", "raw", "play", "edit"};
+    static const int bits[] = {0, 1, 2, 3, 8, 11, 16, 18, 19};
+    for (int i = 0; i < 9; i++)
+      if (k == names[i])
+        return 1u << bits[i];
+    if (k.size() == 1 && isxdigit((unsigned char)k[0]))
+      return 1u << std::strtoul(k.c_str(), NULL, 16);
+    if (k.size() == 1 && k[0] >= 'w' && k[0] <= 'z')
+      return 1u << (16 + k[0] - 'w');
+    if (!k.compare(0, 2, "pb") && k.size() > 2) {
+      uint64_t n = number(k.substr(2));
+      if (n < 20)
+        return 1u << n;
+    }
+    fail("unknown key '" + k + "'");
+    return 0;
+  }
+
+  void add(ScenarioEvent::Kind kind, uint64_t cycle, uint32_t keys = 0, uint64_t count = 0, unsigned value = 0,
+           const std::string& name = "") {
+    events_.push_back({cycle, kind, keys, count, value, name, line_});
+  }
+
+  void command(std::istringstream& words) {
+    std::string cmd, arg;
+    if (!(words >> cmd)) {
+      add(ScenarioEvent::WAIT, now_);
+      return;
+    }
+    std::vector<std::string> args;
+    while (words >> arg)
+      args.push_back(arg);
+
+    if (cmd == "press" || cmd == "release") {
+      if (args.empty())
+        fail(cmd + " needs at least one key");
+      uint32_t keys = 0;
+      for (const std::string& k : args)
+        keys |= cmd == "release" && k == "all" ? 0xfffff : key(k);
+      add(cmd == "press" ? ScenarioEvent::PRESS : ScenarioEvent::RELEASE, now_, keys);
+    }
+    else if (cmd == "reset") {
+      if (args.size() != 1)
+        fail("usage: reset CYCLES");
+      add(ScenarioEvent::RESET_ON, now_);
+      add(ScenarioEvent::RESET_OFF, now_ + number(args[0]));
+    }
+    else if (cmd == "capture") {
+      if (args.size() != 2)
+        fail("usage: capture NAME SAMPLES");
+      uint64_t samples = number(args[1]);
+      if (capture_end_ > now_)
+        fail("capture starts before the previous one has ended");
+      add(ScenarioEvent::CAPTURE, now_, 0, samples, 0, args[0]);
+      capture_end_ = now_ + samples * timing_.sample;
+      add(ScenarioEvent::WAIT, capture_end_);
+      now_ = capture_end_;
+    }
+    else if (cmd == "expect") {
+      static const char* modes[] = {"edit", "play", "raw"};
+      if (args.size() != 2)
+        fail("usage: expect mode M, or expect step N");
+      if (args[0] == "mode") {
+        int m = std::find(modes, modes + 3, args[1]) - modes;
+        if (m == 3)
+          fail("unknown mode '" + args[1] + "' (expected edit, play or raw)");
+        add(ScenarioEvent::EXPECT_MODE, now_, 0, 0, m);
+      }
+      else if (args[0] == "step") {
+        uint64_t step = number(args[1]);
+        if (step > 7)
+          fail("step must be 0 to 7");
+        add(ScenarioEvent::EXPECT_STEP, now_, 0, 0, step);
+      }
+      else
+        fail("can only expect mode or step");
+    }
+    else
+      fail("unknown command '" + cmd + "'");
+  }
+
+  std::string file_;
+  ScenarioTiming timing_;
+  std::vector<ScenarioEvent> events_;
+  int line_ = 0;
+  uint64_t now_ = 0, capture_end_ = 0;
+};
+
+inline std::vector<ScenarioEvent> parse_scenario(const std::string& file, ScenarioTiming timing) {
+  return ScenarioParser(file, timing).parse();
+}
+
+#endif
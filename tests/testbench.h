@@ -0,0 +1,312 @@
+// Shared testbench runtime for the module harnesses in tests/.
+//
+// Every harness used to carry its own copy of cycle_clock, update_tests,
+// bin/pin/pinsel and print_header.  They all live here now, so the stepping
+// path is the same (and equally cheap) for every module.  Everything is
+// inline, so a harness split over several files shares one set of counts.
+//======================================================================
+#ifndef DRUM_MACHINE_TESTBENCH_H
+#define DRUM_MACHINE_TESTBENCH_H
+
+#include <verilated.h>
+#if VM_COVERAGE
+#include <verilated_cov.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+inline int passed_test_count = 0; // every time we perform a test, and the test passes, increment this by one.
+inline int total_test_count = 0;  // every time we perform a test, increment this by one.
+
+// Clock cycles stepped so far on this thread, by every ClockDriver and
+// top's cycle_clocks().  Threaded harnesses add their workers' counts to
+// the main thread's when they join.
+inline thread_local uint64_t cycle_count = 0;
+
+// Current simulation time (64-bit unsigned)
+inline vluint64_t main_time = 0;
+// Called by $time in Verilog
+inline double sc_time_stamp()
+{
+  return main_time; // Note does conversion to real, to match SystemC
+}
+
+/////////////////////////////////////////////////////////////
+// Bit helpers
+
+inline std::string bin(uint64_t b) {
+  std::string ans;
+  if (b == 0)
+    return "0";
+  while (b != 0) {
+    ans += b % 2 == 0 ? "0" : "1";
+    b /= 2;
+  }
+  std::reverse(ans.begin(), ans.end());
+  return ans;
+}
+
+inline std::string padbin(uint64_t x, size_t len) {
+  std::string ans = bin(x);
+  if (ans.length() < len)
+    ans.insert(0, len - ans.length(), '0');
+  return ans;
+}
+
+inline uint64_t pin(uint64_t a, int b) {
+  return (a >> b) & 1;
+}
+
+// OR-reduction of bits a..b of x (inclusive, a < b).
+inline uint64_t pinsel(uint64_t x, int a, int b) {
+  assert(a < b);
+  return ((x >> a) & ((2ull << (b - a)) - 1)) != 0;
+}
+
+// The field x[hi:lo], shifted down to bit 0.
+inline uint64_t pinfield(uint64_t x, int hi, int lo) {
+  assert(lo < hi);
+  return (x >> lo) & ((2ull << (hi - lo)) - 1);
+}
+
+/////////////////////////////////////////////////////////////
+// Reporting
+
+// write a C++ function that takes a string, and pads it with dashes on both sides of the string
+// such that the total length of the output string is `width` characters, and prints it out.
+inline void print_header(const std::string& s, int width = 50) {
+  int pad = (width - (int)s.length()) / 2;
+  std::string dashes(pad > 0 ? pad : 0, '-');
+  std::cout << dashes << " " << s << " " << dashes << "\n";
+}
+
+// A batch of subtests.  check() is branch-free on the pass path so it can
+// sit inside the per-cycle loops without costing more than the compare.
+struct Checks {
+  int passed = 0;
+  int total = 0;
+
+  inline bool check(bool cond) {
+    passed += cond;
+    total++;
+    return cond;
+  }
+  inline bool operator()(bool cond) { return check(cond); }
+};
+
+/////////////////////////////////////////////////////////////
+// Structured results
+//
+// Every update_tests() call is also kept as a record of the part's name,
+// checks passed and run, and the cycles and wall time since the previous
+// record.  report_tests() writes them as a single JSON line to
+// +results=<file> and as a JUnit testsuite to +junit=<file>, under the
+// name given by +suite=<name> (default "tests").  Harnesses that report
+// on their own call write_results() instead.
+
+struct TestRecord {
+  std::string name;
+  int passed, total;
+  uint64_t cycles;
+  double seconds;
+};
+inline std::vector<TestRecord> test_records;
+inline std::chrono::steady_clock::time_point record_mark = std::chrono::steady_clock::now();
+inline uint64_t record_cycles = 0;
+
+inline std::string plusarg(const char* name, const std::string& dflt) {
+  std::string prefix = std::string("+") + name + "=";
+  const char* arg = Verilated::commandArgsPlusMatch(prefix.c_str() + 1);
+  return arg[0] && !prefix.compare(0, prefix.size(), arg, prefix.size()) ? std::string(arg + prefix.size()) : dflt;
+}
+
+inline std::string escaped(const std::string& s, bool xml) {
+  std::string out;
+  for (char c : s) {
+    if (xml && c == '<') out += "&lt;";
+    else if (xml && c == '>') out += "&gt;";
+    else if (xml && c == '&') out += "&amp;";
+    else if (xml && c == '"') out += "&quot;";
+    else if (!xml && (c == '"' || c == '\\')) out += std::string("\\") + c;
+    else if ((unsigned char)c >= 0x20) out += c;
+  }
+  return out;
+}
+
+inline void write_results() {
+  std::string suite = plusarg("suite", "tests");
+  std::string json = plusarg("results", ""), junit = plusarg("junit", "");
+  uint64_t cycles = 0;
+  double seconds = 0;
+  int failed = 0;
+  for (const TestRecord& r : test_records) {
+    cycles += r.cycles;
+    seconds += r.seconds;
+    failed += r.passed != r.total;
+  }
+  char num[64];
+  if (!json.empty()) {
+    std::ofstream f(json);
+    snprintf(num, sizeof(num), "%.6f", seconds);
+    f << "{\"suite\": \"" << escaped(suite, false) << "\", \"passed\": " << passed_test_count << ", \"total\": "
+      << total_test_count << ", \"failed_parts\": " << failed << ", \"cycles\": " << cycles << ", \"wall_s\": " << num
+      << ", \"tests\": [";
+    for (size_t i = 0; i < test_records.size(); i++) {
+      const TestRecord& r = test_records[i];
+      snprintf(num, sizeof(num), "%.6f", r.seconds);
+      f << (i ? ", " : "") << "{\"name\": \"" << escaped(r.name, false) << "\", \"status\": \""
+        << (r.passed == r.total ? "pass" : "fail") << "\", \"passed\": " << r.passed << ", \"total\": " << r.total
+        << ", \"cycles\": " << r.cycles << ", \"wall_s\": " << num << "}";
+    }
+    f << "]}\n";
+  }
+  if (!junit.empty()) {
+    std::ofstream f(junit);
+    snprintf(num, sizeof(num), "%.6f", seconds);
+    f << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    f << "<testsuite name=\"" << escaped(suite, true) << "\" tests=\"" << test_records.size() << "\" failures=\""
+      << failed << "\" time=\"" << num << "\">\n";
+    for (const TestRecord& r : test_records) {
+      snprintf(num, sizeof(num), "%.6f", r.seconds);
+      f << "  <testcase classname=\"" << escaped(suite, true) << "\" name=\"" << escaped(r.name, true) << "\" time=\""
+        << num << "\">\n";
+      f << "    <properties><property name=\"cycles\" value=\"" << r.cycles << "\"/><property name=\"checks\" value=\""
+        << r.total << "\"/></properties>\n";
+      if (r.passed != r.total)
+        f << "    <failure message=\"" << r.total - r.passed << " of " << r.total << " checks failed\"/>\n";
+      f << "  </testcase>\n";
+    }
+    f << "</testsuite>\n";
+  }
+}
+
+inline void update_tests(int passed, int total, const std::string& test, const std::string& label = "Part ") {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  test_records.push_back({label + test, passed, total, cycle_count - record_cycles,
+                          std::chrono::duration<double>(now - record_mark).count()});
+  record_mark = now;
+  record_cycles = cycle_count;
+  // add tests to global test variables
+  passed_test_count += passed;
+  total_test_count += total;
+  // perform sanity check on global test variables
+  assert(passed_test_count <= total_test_count);
+  // let TA know if this set of tests failed
+  std::cout << label << test << ": " << std::to_string(passed) << " out of " << std::to_string(total) << " tests passed.\n";
+}
+
+inline void update_tests(Checks& checks, const std::string& test, const std::string& label = "Part ") {
+  update_tests(checks.passed, checks.total, test, label);
+  checks = Checks();
+}
+
+// Prints the overall result and returns the process exit code.
+inline int report_tests() {
+  // good to have to detect bugs
+  assert(passed_test_count <= total_test_count);
+  write_results();
+
+  if (passed_test_count == total_test_count) {
+    std::cout << "ALL " << std::to_string(total_test_count) << " TESTS PASSED" << "\n";
+    return 0;
+  }
+  std::cout << "ERROR: " << std::to_string(passed_test_count) << "/" << std::to_string(total_test_count) << " tests passed.\n";
+  return 1;
+}
+
+// Coverage builds (make coverage) write the counts of every model in
+// contextp to +coverage_file=<name>, default coverage.dat.  A test with
+// several contexts gives each a suffix, which goes before the extension.
+// Without --coverage this does nothing.
+inline void write_coverage(VerilatedContext* contextp = Verilated::threadContextp(), const std::string& suffix = "") {
+#if VM_COVERAGE
+  const char* arg = Verilated::commandArgsPlusMatch("coverage_file=");
+  std::string file = *arg ? std::string(arg + 15) : "coverage.dat";
+  size_t dot = file.rfind(".dat");
+  if (dot == std::string::npos || dot + 4 != file.size())
+    dot = file.size();
+  contextp->coveragep()->write((file.substr(0, dot) + suffix + file.substr(dot)).c_str());
+#else
+  if (0 && contextp && suffix.size()) {}
+#endif
+}
+
+/////////////////////////////////////////////////////////////
+// Clocking
+
+struct NoEdgeHook {
+  inline void operator()(uint64_t) {}
+};
+
+// Drives one clock input of a Verilated model.  A cycle is a rising edge
+// followed by a falling edge, one eval() per edge and nothing else; inputs
+// poked between cycles are picked up by the next edge's eval(), so callers
+// only need settle() when they want to observe combinational outputs
+// before clocking.
+//
+// If a VerilatedContext is given, time advances by one unit per edge and
+// the hook is called with the new time (e.g. to dump a trace).
+template <class Vmodel, class EdgeHook = NoEdgeHook>
+class ClockDriver {
+public:
+  ClockDriver(Vmodel* model, CData& clk, VerilatedContext* contextp = nullptr, EdgeHook hook = EdgeHook())
+      : model_(model), clk_(clk), contextp_(contextp), hook_(hook) {}
+
+  inline void settle() { model_->eval(); }
+
+  inline void rise() { edge(1); }
+  inline void fall() { edge(0); }
+
+  // n full clock cycles.
+  inline void step(uint64_t n = 1) {
+    for (uint64_t i = 0; i < n; i++) {
+      edge(1);
+      edge(0);
+    }
+    cycles_ += n;
+    cycle_count += n;
+  }
+
+  // n full clock cycles, calling each() after every falling edge, which is
+  // where the module tests sample outputs.
+  template <class Fn>
+  inline void step(uint64_t n, Fn&& each) {
+    for (uint64_t i = 0; i < n; i++) {
+      edge(1);
+      edge(0);
+      each();
+    }
+    cycles_ += n;
+    cycle_count += n;
+  }
+
+  uint64_t cycles() const { return cycles_; }
+  Vmodel* model() const { return model_; }
+  EdgeHook& hook() { return hook_; }
+
+private:
+  inline void edge(CData level) {
+    clk_ = level;
+    model_->eval();
+    if (contextp_) {
+      contextp_->timeInc(1);
+      hook_(contextp_->time());
+    }
+  }
+
+  Vmodel* model_;
+  CData& clk_;
+  VerilatedContext* contextp_;
+  EdgeHook hook_;
+  uint64_t cycles_ = 0;
+};
+
+#endif
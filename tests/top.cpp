@@ -7,18 +7,47 @@
 // Include common routines
 #include <verilated.h>
 
-static int passed_test_count = 0; // every time we perform a test, and the test passes, increment this by one.
-static int total_test_count = 0;  // every time we perform a test, increment this by one.
+// Shared harness: clocking, checks and reporting
+#include "testbench.h"
 
 // Include model header, generated from Verilating "tb_top.v"
 #include "Vtop.h"
 
-#include <alsa/asoundlib.h>
-#include "verilated_fst_c.h"
-static VerilatedFstC* tfp = new VerilatedFstC;
-const std::unique_ptr<VerilatedContext> contextp{new VerilatedContext};
-
-static std::string device = "default";            /* playback device */
+#include "top_harness.h"
+#include "top_checkpoint.h"
+#include "audio_sink.h"
+#include "audio_stream.h"
+#include "pwm_demod.h"
+#include "fork_scenarios.h"
+
+// Audio goes to ALSA, a WAV file or nowhere; see audio_sink.h.
+static AudioSink* sink = NULL;
+
+// With +stream, every recorded sample is also handed to an audio thread
+// that plays it while the rest renders (see audio_stream.h).
+//   +stream               stream instead of playing the batch in Test 7
+//   +stream_prebuffer=ms  audio queued before playback starts (default 100)
+static AudioStream* stream = NULL;
+
+// Turns right[0] into PCM; +demod* plusargs pick the filter (see
+// pwm_demod.h).  The sample rate is HZ2M / demod->window().
+static PwmDemod* demod = NULL;
+
+// The preamble (reset, Tests 1 and 2, and the wait before the kick) can be
+// saved once and restored by later runs instead of simulated again; see
+// top_checkpoint.h.
+//   +checkpoint_save=file  write the state just before the kick is pressed
+//   +checkpoint_load=file  start from that state, skipping the preamble
+static std::string checkpoint_save, checkpoint_load;
+
+// With +fork, Tests 3 to 6 each run in a child process forked from the
+// state every recording starts from (see fork_scenarios.h), so each drum
+// is pressed from the same idle state instead of after the previous one's
+// tail, and the four render on separate cores.  Tracing turns it off.
+//   +fork          record the four drums in parallel
+//   +fork_jobs=N   children running at once (default one per core)
+static bool forking = false;
+static unsigned fork_jobs = 0;
 
 // Verilator using new C++?  Need to include these now.
 #include <iostream>
@@ -27,69 +56,80 @@ static std::string device = "default";            /* playback device */
 using namespace std::this_thread; // sleep_for, sleep_until
 using namespace std::chrono; // nanoseconds, system_clock, seconds
 
-// Current simulation time (64-bit unsigned)
-vluint64_t main_time = 0;
-// Called by $time in Verilog
-double sc_time_stamp()
-{
-  return main_time; // Note does conversion to real, to match SystemC
-}
-
-// write a C++ function that takes a string, and pads it with dashes on both sides of the string 
-// such that the total length of the output string is 80 characters, and prints it out.
-void print_header(std::string s) {
-  int n = s.length();
-  int pad = (50 - n) / 2;
-  std::string dashes = "";
-  for (int i = 0; i < pad; i++) {
-    dashes += "-";
-  }
-  std::cout << dashes << " " << s << " " << dashes << "\n";
-}
-
-static int TIMESTEP = 0;
-static int MOD_M = 10000;
-void cycle_clocks(Vtop* top, int n) {
-  while (n--) {
-    top->hz2m = 0; top->eval();
-    contextp->timeInc(1);
-    tfp->dump(contextp->time());
-    top->hz2m = 1; top->eval();
-    TIMESTEP++;
-    if (TIMESTEP == MOD_M) {
-        top->hz100 = (top->hz100 == 1) ? 0 : 1; 
-        top->eval();
-        TIMESTEP = 0;
-    }
-    contextp->timeInc(1);
-    tfp->dump(contextp->time());
-  }
-}
-
-void record_audio(Vtop* top, unsigned char sample[], int sample_len) {
-  for (int i = 0; i < sample_len - 1500; i++) {
-    int ones = 0;
-    int zeroes = 0;
-    for (int j = 0; j < 256; j++) {
+void record_audio(Vtop* top, int16_t sample[], int sample_len) {
+  std::vector<int16_t> pcm;
+  demod->reset();
+  // decode a block at a time so a +stream listener is never far behind
+  for (int i = 0; i < sample_len - 1500; ) {
+    int block = std::min(64, sample_len - 1500 - i);
+    for (uint64_t j = 0; j < (uint64_t)block * demod->window(); j++) {
       cycle_clocks(top, 1);
-      if (top->right & 0x1)
-        ones++;
-      else
-        zeroes++;
+      demod->push(top->right & 0x1);
     }
-    sample[i] = ones & 0xff;
+    pcm.clear();
+    demod->decode(pcm);
+    std::copy(pcm.begin(), pcm.end(), sample + i);
+    if (stream)
+      stream->push(pcm.data(), pcm.size());
+    i += pcm.size();
   }
   for (int i = sample_len - 1500; i < sample_len; i++) {
-    sample[i] = 0x80;
+    sample[i] = 0;
   }
+  if (stream)
+    stream->push(sample + sample_len - 1500, 1500);
 }
 
-// https://www.alsa-project.org/alsa-doc/alsa-lib/_2test_2pcm_min_8c-example.html
-void play_audio(Vtop* top, snd_pcm_t *handle, snd_pcm_sframes_t frames, unsigned char sample[], long sample_len) {
+void play_audio(Vtop* top, AudioSink* sink, long frames, int16_t sample[], long sample_len) {
   if (frames > 0 && frames < (long)sample_len)
       printf("Short write (expected %li, wrote %li)\n", (long)sample_len, frames);
 }
 
+// One recording made in a forked child: its PCM and the hz2m cycles it
+// took, in memory shared with the parent.
+struct ForkedRecording {
+  uint64_t cycles;
+  int16_t pcm[8000];
+};
+
+// Tests 3 to 6 under +fork: one child per drum, each pressing it from the
+// current state; the parent gathers the PCM and whether each child
+// finished.
+void record_forked(Vtop* top, int16_t* samples[4]) {
+  static const int drums[] = {KICK, CLAP, HIHAT, SNARE};
+  static const char* names[] = {"kick", "clap", "hihat", "snare"};
+  SharedSlots<ForkedRecording> slots(4);
+  std::cout << "\nTests 3-6: Recording a kick, clap, hihat and snare in forked children, " << fork_jobs
+            << " at a time..." << "\n";
+  std::vector<int> status = fork_scenarios(slots, fork_jobs, [&](size_t i, ForkedRecording& out) {
+    // the audio thread was not forked with us
+    stream = NULL;
+    uint64_t start = cycle_count;
+    top->pb = 1 << drums[i];
+    cycle_clocks(top, MOD_M * 2 * 2);
+    // 4000 samples, 256 bits, 8000 sample rate, played 10 times.
+    record_audio(top, out.pcm, 8000);
+    out.cycles = cycle_count - start;
+    top->final();
+    write_coverage(contextp.get(), std::string("_") + names[i]);
+    return 0;
+  });
+
+  for (int i = 0; i < 4; i++) {
+    bool ok = status[i] == 0;
+    if (ok) {
+      std::copy(slots[i].pcm, slots[i].pcm + 8000, samples[i]);
+      cycle_count += slots[i].cycles;
+      if (stream)
+        stream->push(samples[i], 8000);
+    }
+    else
+      std::fill(samples[i], samples[i] + 8000, 0);
+    update_tests(ok, 1, std::string(names[i]) + " recorded in a forked child",
+                 "Test " + std::to_string(i + 3) + ": ");
+  }
+}
+
 int main(int argc, char **argv, char **env)
 {
   // This is a more complicated example, please also see the simpler examples/make_hello_c.
@@ -112,176 +152,205 @@ int main(int argc, char **argv, char **env)
   // This needs to be called before you create any model
   Verilated::commandArgs(argc, argv);
 
+  bool streaming = false;
+  unsigned prebuffer_ms = 100;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "+stream")
+      streaming = true;
+    else if (!arg.compare(0, 18, "+stream_prebuffer="))
+      prebuffer_ms = std::strtoul(arg.c_str() + 18, NULL, 0);
+    else if (arg == "+fork")
+      forking = true;
+    else if (!arg.compare(0, 11, "+fork_jobs="))
+      fork_jobs = std::strtoul(arg.c_str() + 11, NULL, 0);
+  }
+  checkpoint_save = plusarg("checkpoint_save", "");
+  checkpoint_load = plusarg("checkpoint_load", "");
+  if (!fork_jobs)
+    fork_jobs = std::thread::hardware_concurrency();
+
   // enable tracing
   Verilated::traceEverOn(true);
 
   // Construct the Verilated model, from each module after Verilating each module file
   Vtop *top = new Vtop; // Or use a const unique_ptr, or the VL_UNIQUE_PTR wrapper
 
-  top->trace(tfp, 9);
-  tfp->open("top.fst");
-
-  // top
-  int TO_EDIT = 19;
-  int TO_PLAY = 18;
-  int TO_RAW = 16;
-
-  int KICK  = 3;
-  int CLAP  = 2;
-  int HIHAT = 1;
-  int SNARE = 0;
-
   // test top reset
-  top->hz2m = 0; 
-  top->hz100 = 0; 
-  top->reset = 0; 
-  top->pb = 0;
-  top->eval();
-  contextp->timeInc(1);
-  tfp->dump(contextp->time());
+  // tracing is off unless enabled by +trace* plusargs, see top_trace.h
+  top_harness_init(top, argc, argv);
   
   /////////////////////////////////////////////////////////////
   // this is a testbench that will perform the following actions on your 
   // top module implementing the drum machine:
 
-  // assert reset for 5 clock cycles of hz2m.
-  top->reset = 1;
-  top->eval();
-  cycle_clocks(top, 5);
-
-  top->reset = 0;
-  top->eval();
-
-  std::cout << "Test 1: Just after reset, we should be in EDIT mode (blue = 1)." << "\n";
-  std::cout << "blue: " << std::to_string(top->blue) << "\n";
-  std::cout << "green: " << std::to_string(top->green) << "\n";
-  std::cout << "red: " << std::to_string(top->red) << "\n";
-
-  // switch to RAW
-  top->pb = 1 << TO_RAW; top->eval();
-  cycle_clocks(top, MOD_M * 2 * 1);
-
-  std::cout << "\nTest 2: Pressing W should take us to RAW mode (red = 1)." << "\n";
-  std::cout << "blue: " << std::to_string(top->blue) << "\n";
-  std::cout << "green: " << std::to_string(top->green) << "\n";
-  std::cout << "red: " << std::to_string(top->red) << "\n";
+  if (!checkpoint_load.empty()) {
+    uint64_t cycle = restore_checkpoint(top, checkpoint_load);
+    std::cout << "Restored " << checkpoint_load << " at hz2m cycle " << cycle
+              << ", with the results of Tests 1 and 2." << "\n";
+  }
+  else {
+    // assert reset for 5 clock cycles of hz2m.
+    top->reset = 1;
+    cycle_clocks(top, 5);
+
+    top->reset = 0;
+    top->eval();
+
+    std::cout << "Test 1: Just after reset, we should be in EDIT mode (blue = 1)." << "\n";
+    std::cout << "blue: " << std::to_string(top->blue) << "\n";
+    std::cout << "green: " << std::to_string(top->green) << "\n";
+    std::cout << "red: " << std::to_string(top->red) << "\n";
+    bool edit = top->blue && !top->green && !top->red;
+    if (!edit)
+      tracer->mismatch();
+    update_tests(edit, 1, "EDIT after reset", "Test 1: ");
+
+    // switch to RAW
+    top->pb = 1 << TO_RAW;
+    cycle_clocks(top, MOD_M * 2 * 1);
+
+    std::cout << "\nTest 2: Pressing W should take us to RAW mode (red = 1)." << "\n";
+    std::cout << "blue: " << std::to_string(top->blue) << "\n";
+    std::cout << "green: " << std::to_string(top->green) << "\n";
+    std::cout << "red: " << std::to_string(top->red) << "\n";
+    bool raw = !top->blue && !top->green && top->red;
+    if (!raw)
+      tracer->mismatch();
+    update_tests(raw, 1, "RAW after W", "Test 2: ");
+  }
 
   // initialize audio
-  unsigned char kick_sample[8000];
-  unsigned char clap_sample[8000];
-  unsigned char hihat_sample[8000];
-  unsigned char snare_sample[8000];
-  unsigned char sample[8000*4 + 4000*4];
-  snd_pcm_t *handle;
-  snd_pcm_sframes_t frames;
+  int16_t kick_sample[8000];
+  int16_t clap_sample[8000];
+  int16_t hihat_sample[8000];
+  int16_t snare_sample[8000];
+  int16_t sample[8000*4 + 4000*4];
+  long frames;
 
   std::cout << "\nInitializing audio library..." << "\n";
-  int err;
-  if ((err = snd_pcm_open(&handle, device.c_str(), SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
-    printf("Playback open error: %s\n", snd_strerror(err));
-    exit(EXIT_FAILURE);
+  demod = new PwmDemod(argc, argv);
+  unsigned rate = HZ2M / demod->window();
+  sink = make_audio_sink(argc, argv, rate);
+  std::cout << "Audio sink: " << sink->name() << "\n";
+  // give a real device time to settle; files and null don't need it
+  if (sink->realtime())
+    sleep_until(system_clock::now() + seconds(1));
+  if (streaming)
+    stream = new AudioStream(sink, rate, rate, prebuffer_ms * rate / 1000);
+
+  // Every recording starts from here: buttons released for 4 hz100 cycles.
+  if (checkpoint_load.empty()) {
+    // release all buttons...
+    top->pb = 0;
+    // let 4 hz100 cycles pass...
+    cycle_clocks(top, MOD_M * 2 * 2);
+    if (!checkpoint_save.empty()) {
+      save_checkpoint(top, checkpoint_save);
+      std::cout << "Saved the preamble to " << checkpoint_save << "\n";
+    }
   }
-  if ((err = snd_pcm_set_params(handle,
-              SND_PCM_FORMAT_U8,
-              SND_PCM_ACCESS_RW_INTERLEAVED,
-              1,
-              8000,
-              1,
-              50000)) < 0) {   /* 0.5sec */
-    printf("Playback open error: %s\n", snd_strerror(err));
-    exit(EXIT_FAILURE);
+
+  if (forking && tracer->tracing()) {
+    std::cout << "\n+fork is off while tracing, recording one drum at a time" << "\n";
+    forking = false;
   }
-  sleep_until(system_clock::now() + seconds(1));
-
-  std::cout << "\nTest 3: Recording a kick..." << "\n";
-  // release all buttons...
-  top->pb = 0; top->eval();
-  // let 4 hz100 cycles pass...
-  cycle_clocks(top, MOD_M * 2 * 2);
-
-  // now play a kick.
-  top->pb = 1 << KICK; top->eval();
-  cycle_clocks(top, MOD_M * 2 * 2);
-  // 4000 samples, 256 bits, 8000 sample rate, played 10 times.
-  record_audio(top, kick_sample, sizeof(kick_sample));
-
-  std::cout << "\nTest 4: Recording a clap..." << "\n";
-  // release all buttons...
-  top->pb = 0; top->eval();
-  // let 4 hz100 cycles pass...
-  cycle_clocks(top, MOD_M * 2 * 8);
-
-  // now play a clap.
-  top->pb = 1 << CLAP; top->eval();
-  cycle_clocks(top, MOD_M * 2 * 2);
-  // 4000 samples, 256 bits, 8000 sample rate, played 10 times.
-  record_audio(top, clap_sample, sizeof(clap_sample));
-
-  std::cout << "\nTest 5: Recording a hihat..." << "\n";
-
-  // release all buttons...
-  top->pb = 0; top->eval();
-  // let 4 hz100 cycles pass...
-  cycle_clocks(top, MOD_M * 2 * 8);
-
-  // now play a hihat.
-  top->pb = 1 << HIHAT; top->eval();
-  cycle_clocks(top, MOD_M * 2 * 2);
-  // 4000 samples, 256 bits, 8000 sample rate, played 10 times.
-  record_audio(top, hihat_sample, sizeof(hihat_sample));
-
-  std::cout << "\nTest 6: Recording a snare..." << "\n";
-  // release all buttons...
-  top->pb = 0; top->eval();
-  // let 4 hz100 cycles pass...
-  cycle_clocks(top, MOD_M * 2 * 8);
-
-  // now play a snare.
-  top->pb = 1 << SNARE; top->eval();
-  cycle_clocks(top, MOD_M * 2 * 2);
-  // 4000 samples, 256 bits, 8000 sample rate, played 10 times.
-  record_audio(top, snare_sample, sizeof(snare_sample));
-
-  std::cout << "\nTest 7: Playing back all recorded sound (should hear each sample 2 times)" << "\n";
-  unsigned char* sample_ptr = NULL;
-  for (int i = 0; i < 8000*4 + 4000*4; i++) {
-    sample[i] = 0x80;
+  if (forking) {
+    int16_t* samples[] = {kick_sample, clap_sample, hihat_sample, snare_sample};
+    record_forked(top, samples);
   }
-  for (int i = 0; i < 4; i++) {
-    switch (i) {
-      case 0:
-        sample_ptr = kick_sample;
-        break;
-      case 1:
-        sample_ptr = clap_sample;
-        break;
-      case 2:
-        sample_ptr = hihat_sample;
-        break;
-      case 3:
-        sample_ptr = snare_sample;
-        break;
+  else {
+    std::cout << "\nTest 3: Recording a kick..." << "\n";
+    // now play a kick.
+    top->pb = 1 << KICK;
+    cycle_clocks(top, MOD_M * 2 * 2);
+    // 4000 samples, 256 bits, 8000 sample rate, played 10 times.
+    record_audio(top, kick_sample, 8000);
+
+    std::cout << "\nTest 4: Recording a clap..." << "\n";
+    // release all buttons...
+    top->pb = 0;
+    // let 4 hz100 cycles pass...
+    cycle_clocks(top, MOD_M * 2 * 8);
+
+    // now play a clap.
+    top->pb = 1 << CLAP;
+    cycle_clocks(top, MOD_M * 2 * 2);
+    // 4000 samples, 256 bits, 8000 sample rate, played 10 times.
+    record_audio(top, clap_sample, 8000);
+
+    std::cout << "\nTest 5: Recording a hihat..." << "\n";
+
+    // release all buttons...
+    top->pb = 0;
+    // let 4 hz100 cycles pass...
+    cycle_clocks(top, MOD_M * 2 * 8);
+
+    // now play a hihat.
+    top->pb = 1 << HIHAT;
+    cycle_clocks(top, MOD_M * 2 * 2);
+    // 4000 samples, 256 bits, 8000 sample rate, played 10 times.
+    record_audio(top, hihat_sample, 8000);
+
+    std::cout << "\nTest 6: Recording a snare..." << "\n";
+    // release all buttons...
+    top->pb = 0;
+    // let 4 hz100 cycles pass...
+    cycle_clocks(top, MOD_M * 2 * 8);
+
+    // now play a snare.
+    top->pb = 1 << SNARE;
+    cycle_clocks(top, MOD_M * 2 * 2);
+    // 4000 samples, 256 bits, 8000 sample rate, played 10 times.
+    record_audio(top, snare_sample, 8000);
+  }
+
+  if (stream) {
+    std::cout << "\nTest 7: Skipped, the samples were streamed as they were recorded" << "\n";
+    stream->close();
+    delete stream;
+    stream = NULL;
+  }
+  else {
+    std::cout << "\nTest 7: Playing back all recorded sound (should hear each sample 2 times)" << "\n";
+    int16_t* sample_ptr = NULL;
+    for (int i = 0; i < 8000*4 + 4000*4; i++) {
+      sample[i] = 0;
     }
-    for (int j = 0; j < 8000; j++) {
-      sample[j + (i * 4000) + (i * 8000)] = sample_ptr[j];
+    for (int i = 0; i < 4; i++) {
+      switch (i) {
+        case 0:
+          sample_ptr = kick_sample;
+          break;
+        case 1:
+          sample_ptr = clap_sample;
+          break;
+        case 2:
+          sample_ptr = hihat_sample;
+          break;
+        case 3:
+          sample_ptr = snare_sample;
+          break;
+      }
+      for (int j = 0; j < 8000; j++) {
+        sample[j + (i * 4000) + (i * 8000)] = sample_ptr[j];
+      }
     }
-  }
 
-  frames = snd_pcm_writei(handle, sample, sizeof(sample));
-  if (frames < 0)
-      frames = snd_pcm_recover(handle, frames, 0);
-  if (frames < 0) {
-      printf("snd_pcm_writei failed: %s\n", snd_strerror(frames));
+    frames = sink->write(sample, 8000*4 + 4000*4);
+    play_audio(top, sink, frames, sample, 8000*4 + 4000*4);
   }
-  play_audio(top, handle, frames, sample, sizeof(sample));
 
-  tfp->close();
 
   // if (err < 0)
   //     printf("snd_pcm_drain failed: %s\n", snd_strerror(err));
-  sleep_until(system_clock::now() + seconds(1));
+  if (sink->realtime())
+    sleep_until(system_clock::now() + seconds(1));
   // close sound device
-  snd_pcm_close(handle);
+  delete sink;
+  sink = NULL;
+  delete demod;
+  demod = NULL;
 
   std::cout << "\nIf you were able to hear the samples, great!  If not, there may be something wrong with "
             << "your audio setup.  Ensure you are following the same settings as "
@@ -292,8 +361,10 @@ int main(int argc, char **argv, char **env)
   /////////////////////////////////////////////////////////////
 
   top->final();
+  write_results();
 
   // Destroy models
+  top_harness_final();
   delete top;
   top = NULL;
 
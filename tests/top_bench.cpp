@@ -0,0 +1,166 @@
+// DESCRIPTION: Verilator: Verilog example module
+//
+// This file ONLY is placed under the Creative Commons Public Domain, for
+// any use, without warranty, 2017 by Wilson Snyder.
+// SPDX-License-Identifier: CC0-1.0
+//======================================================================
+// Simulation speed benchmark for top.
+//
+// Runs the drum machine in RAW mode, pressing each drum in turn so the
+// sample and pwm paths stay busy, and reports simulated hz2m cycles per
+// second.  The same source is built at several --threads counts by the
+// bench_threads target; +trace (see top_trace.h) measures with tracing.
+//
+//   +cycles=N    hz2m cycles to time after the warm-up (default 2000000)
+//======================================================================
+// Include common routines
+#include <verilated.h>
+
+// Shared harness: clocking, checks and reporting
+#include "top_harness.h"
+
+// C++ reference model, and the .mem loader for its ROMs
+#include "top_model.h"
+#include "mem_image.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+enum Workload { IDLE, KEYS, AUDIO };
+static const char* WORKLOAD_NAMES[] = {"idle", "keys", "audio"};
+
+// Buttons held during press i of workload w, and how long each press is.
+static uint32_t press_pb(Workload w, uint64_t i) {
+  static const int drums[] = {KICK, CLAP, HIHAT, SNARE};
+  static const int keys[] = {KICK, 8, CLAP, 11, HIHAT, 8, SNARE, 11}; // 8/11: step right/left
+  if (w == IDLE || (i & 1))
+    return 0;
+  return 1u << (w == KEYS ? keys[(i / 2) % 8] : drums[(i / 2) % 4]);
+}
+static uint64_t press_cycles(Workload w) {
+  return w == KEYS ? 64 : MOD_M * 2 * 2;
+}
+
+// cycle_clocks() for the model: n hz2m cycles, toggling hz100 every MOD_M.
+// timestep counts the hz2m cycles since hz100 last toggled.
+static void model_cycles(TopModel* model, uint64_t n, int& timestep) {
+  while (n) {
+    uint64_t k = std::min<uint64_t>(n, MOD_M - timestep);
+    model->run(k);
+    n -= k;
+    timestep += k;
+    if (timestep == MOD_M) {
+      model->hz100 ^= 1;
+      model->eval();
+      timestep = 0;
+    }
+  }
+}
+
+// The timed part of a workload: wall time and eval() calls.
+struct Timing {
+  double seconds;
+  uint64_t evals;
+};
+
+// Resets m, enters the workload's mode, then times cycles of its presses.
+// step(m, n) runs n hz2m cycles and evals() gives the eval() calls so far.
+template <class M, class Step, class Evals>
+static Timing run_workload(M* m, Workload w, uint64_t cycles, Step step, Evals evals) {
+  m->reset = 1;
+  step(m, 5);
+  m->reset = 0;
+  m->pb = 1 << (w == AUDIO ? TO_RAW : TO_EDIT);
+  step(m, MOD_M * 2);
+  m->pb = 0;
+  step(m, MOD_M * 2);
+
+  const uint64_t press = press_cycles(w);
+  uint64_t evals_before = evals();
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t done = 0, i = 0; done < cycles; i++) {
+    uint64_t n = std::min(press, cycles - done);
+    m->pb = press_pb(w, i);
+    step(m, n);
+    done += n;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return {seconds, evals() - evals_before};
+}
+
+// The same workloads on TopModel, each on a fresh model from hz100's
+// first cycle.
+static void bench_model(uint64_t cycles, const std::string& only) {
+  std::array<std::vector<uint8_t>, 4> roms;
+  const char* drums[] = {"kick", "clap", "hihat", "snare"};
+  for (int d = 0; d < 4; d++)
+    roms[d] = load_mem(std::string("../audio/") + drums[d] + ".mem", 4096);
+
+  for (int w = IDLE; w <= AUDIO; w++) {
+    if (!only.empty() && only != WORKLOAD_NAMES[w])
+      continue;
+    TopModel* model = new TopModel(roms);
+    int timestep = 0;
+    Timing t = run_workload(
+        model, Workload(w), cycles, [&](TopModel* m, uint64_t n) { model_cycles(m, n, timestep); },
+        [] { return uint64_t(0); });
+    // run() skips ahead without eval(), so there is no time per eval
+    printf("bench top_model workload=%s trace=0 cycles=%llu seconds=%.3f cycles_per_sec=%.0f ns_per_eval=-\n",
+           WORKLOAD_NAMES[w], (unsigned long long)cycles, t.seconds, cycles / t.seconds);
+    delete model;
+  }
+}
+
+int main(int argc, char **argv, char **env)
+{
+  // Prevent unused variable warnings
+  if (0 && argc && argv && env) {}
+
+  Verilated::debug(0);
+  Verilated::randReset(2);
+  Verilated::traceEverOn(true);
+  Verilated::commandArgs(argc, argv);
+
+  uint64_t cycles = 2000000;
+  std::string only;
+  bool traced = false;
+  bool model = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (!arg.compare(0, 8, "+cycles="))
+      cycles = std::strtoull(arg.c_str() + 8, NULL, 0);
+    else if (!arg.compare(0, 10, "+workload="))
+      only = arg.substr(10);
+    else if (arg == "+trace" || !arg.compare(0, 13, "+trace_start=") || !arg.compare(0, 10, "+trace_on="))
+      traced = true;
+    else if (arg == "+model")
+      model = true;
+  }
+  if (model) {
+    bench_model(cycles, only);
+    return 0;
+  }
+
+  Vtop *top = new Vtop;
+  top_harness_init(top, argc, argv);
+
+  for (int w = IDLE; w <= AUDIO; w++) {
+    if (!only.empty() && only != WORKLOAD_NAMES[w])
+      continue;
+    Timing t = run_workload(
+        top, Workload(w), cycles, [](Vtop* m, uint64_t n) { cycle_clocks(m, n); }, [] { return clocks->evals(); });
+    // the scheduler only evaluates edges that change a pin, so the evals
+    // are counted rather than taken as two per cycle
+    printf("bench top workload=%s threads=%u trace=%d cycles=%llu seconds=%.3f cycles_per_sec=%.0f ns_per_eval=%.2f\n",
+           WORKLOAD_NAMES[w], Verilated::threadContextp()->threads(), traced ? 1 : 0, (unsigned long long)cycles,
+           t.seconds, cycles / t.seconds, t.seconds * 1e9 / t.evals);
+  }
+
+  top->final();
+  top_harness_final();
+  delete top;
+  top = NULL;
+  return 0;
+}
@@ -0,0 +1,116 @@
+// Checkpoints of top and its harness, for a model built with --savable.
+//
+// Every top scenario begins with the same preamble: reset, a press of W
+// to enter RAW mode and a few hz100 periods of waiting.  That is hundreds
+// of thousands of hz2m cycles before the first interesting one.
+// save_checkpoint() writes the state of Vtop to a file together with the
+// state of the harness that drives it: the hz100 divider count, MOD_M,
+// the context time, the hz2m cycle the tracer has reached, and the test
+// counts and records so far.  restore_checkpoint() puts all of that back,
+// so a run can pick up from the snapshot as if it had simulated the
+// preamble itself.
+//
+// A checkpoint only loads into the Vtop build that wrote it; Verilator's
+// own header check rejects any other.  Restore right after
+// top_harness_init(), before the first cycle.
+//======================================================================
+#ifndef DRUM_MACHINE_TOP_CHECKPOINT_H
+#define DRUM_MACHINE_TOP_CHECKPOINT_H
+
+#include <verilated.h>
+#include <verilated_save.h>
+
+#include "top_harness.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static const char* CHECKPOINT_MAGIC = "drum_machine top checkpoint 1";
+
+// The harness state stored ahead of the model in a checkpoint.
+struct Checkpoint {
+  QData time = 0;   // contextp time
+  QData cycle = 0;  // hz2m cycles since power-on
+  IData timestep = 0; // hz2m rises since hz100 last toggled
+  IData mod_m = 0;
+  IData passed = 0, total = 0;
+  std::vector<TestRecord> records;
+};
+
+static void checkpoint_fail(const std::string& file, const std::string& why) {
+  printf("checkpoint %s: %s\n", file.c_str(), why.c_str());
+  exit(EXIT_FAILURE);
+}
+
+// Writes top and the harness state to file.
+void save_checkpoint(Vtop* top, const std::string& file) {
+  VerilatedSave os;
+  os.open(file.c_str());
+  if (!os.isOpen())
+    checkpoint_fail(file, "cannot be written");
+
+  std::string magic = CHECKPOINT_MAGIC;
+  QData time = contextp->time(), cycle = tracer->cycles();
+  IData timestep = clocks->count(hz100_clock), mod_m = MOD_M;
+  IData passed = passed_test_count, total = total_test_count, records = test_records.size();
+  os << magic << time << cycle << timestep << mod_m << passed << total << records;
+  for (TestRecord& r : test_records) {
+    IData p = r.passed, t = r.total;
+    os << r.name << p << t << r.cycles << r.seconds;
+  }
+  os << *top;
+  os.close();
+}
+
+// Reads the harness state from file and loads the model state into model,
+// which need not be top: the tracer's shadow is restored this way too.
+static Checkpoint read_checkpoint(Vtop* model, const std::string& file) {
+  VerilatedRestore os;
+  os.open(file.c_str());
+  if (!os.isOpen())
+    checkpoint_fail(file, "cannot be read");
+
+  std::string magic;
+  Checkpoint c;
+  IData records;
+  os >> magic;
+  if (magic != CHECKPOINT_MAGIC)
+    checkpoint_fail(file, "is not a top checkpoint");
+  os >> c.time >> c.cycle >> c.timestep >> c.mod_m >> c.passed >> c.total >> records;
+  for (IData i = 0; i < records; i++) {
+    TestRecord r;
+    IData p, t;
+    os >> r.name >> p >> t >> r.cycles >> r.seconds;
+    r.passed = p;
+    r.total = t;
+    c.records.push_back(r);
+  }
+  os >> *model;
+  os.close();
+  return c;
+}
+
+// Puts top and the harness back to the state saved in file, and returns
+// the hz2m cycle it was saved at.  The test records saved with it are
+// added to this run's, so the checks of the skipped preamble still count.
+uint64_t restore_checkpoint(Vtop* top, const std::string& file) {
+  Checkpoint c = read_checkpoint(top, file);
+  if (c.mod_m != (IData)MOD_M)
+    checkpoint_fail(file, "was saved with MOD_M " + std::to_string(c.mod_m) + ", this run uses " +
+                              std::to_string(MOD_M));
+
+  contextp->time(c.time);
+  clocks->set_count(hz100_clock, c.timestep);
+  clocks->restart();
+  passed_test_count += c.passed;
+  total_test_count += c.total;
+  test_records.insert(test_records.end(), c.records.begin(), c.records.end());
+  tracer->restored(c.cycle, c.timestep, [&](Vtop* shadow, VerilatedContext* shadow_context) {
+    shadow_context->time(read_checkpoint(shadow, file).time);
+  });
+  return c.cycle;
+}
+
+#endif
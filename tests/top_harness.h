@@ -0,0 +1,87 @@
+// Clocking for the top-level testbenches (top.cpp, top_bench.cpp).
+//
+// The harness drives hz2m and hz100 with a ClockScheduler
+// (clock_scheduler.h): hz2m free-running, hz100 divided from it by
+// 2 * MOD_M, toggling just after the hz2m edge it counts.  Every edge is
+// offered to the tracer, which is off unless enabled with +trace*
+// plusargs (see top_trace.h).
+//======================================================================
+#ifndef DRUM_MACHINE_TOP_HARNESS_H
+#define DRUM_MACHINE_TOP_HARNESS_H
+
+#include "testbench.h"
+#include "clock_scheduler.h"
+#include "top_trace.h"
+#include "Vtop.h"
+
+const std::unique_ptr<VerilatedContext> contextp{new VerilatedContext};
+
+// Hands every hz2m edge to the tracer, which decides whether to dump it.
+static TopTracer* tracer = NULL;
+struct TraceHook {
+  inline void operator()(uint64_t time) { tracer->dump(time); }
+};
+static ClockScheduler<Vtop, TraceHook>* clocks = NULL;
+static int hz2m_clock, hz100_clock;
+
+// pb indices of the mode and drum buttons
+static const int TO_EDIT = 19;
+static const int TO_PLAY = 18;
+static const int TO_RAW = 16;
+
+static const int KICK  = 3;
+static const int CLAP  = 2;
+static const int HIHAT = 1;
+static const int SNARE = 0;
+
+// hz2m on the board, hwclk / 6 in support/ice40hx8k.sv.  Audio captured
+// from right[0] plays at HZ2M / window samples per second (see
+// pwm_demod.h).
+static const unsigned HZ2M = 2000000;
+
+// hz2m cycles per hz100 half period; set before top_harness_init().  The
+// default gives the board's 100 Hz.
+static int MOD_M = 10000;
+
+// n hz2m cycles, each a falling then a rising edge.
+void cycle_clocks(Vtop* top, uint64_t n) {
+  cycle_count += n;
+  if (tracer->idle()) {
+    clocks->step(hz2m_clock, n);
+    tracer->skip(n);
+    return;
+  }
+  while (n--) {
+    clocks->step(hz2m_clock);
+    tracer->cycle();
+  }
+}
+
+// Sets up the tracer and clock for top and applies the power-on inputs.
+void top_harness_init(Vtop* top, int argc, char** argv) {
+  tracer = new TopTracer(top, 2 * MOD_M, argc, argv);
+  clocks = new ClockScheduler<Vtop, TraceHook>(top, contextp.get());
+
+  top->hz2m = 0; 
+  top->hz100 = 0; 
+  top->reset = 0; 
+  top->pb = 0;
+  top->eval();
+  contextp->timeInc(1);
+  tracer->dump(contextp->time());
+  // hz2m rises on odd times from 3 and falls on even ones, one edge per
+  // time unit
+  hz2m_clock = clocks->add(top->hz2m, 2, 1);
+  hz100_clock = clocks->divide(top->hz100, hz2m_clock, 2 * MOD_M);
+}
+
+void top_harness_final() {
+  tracer->finish();
+  write_coverage();
+  delete clocks;
+  clocks = NULL;
+  delete tracer;
+  tracer = NULL;
+}
+
+#endif
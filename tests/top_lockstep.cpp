@@ -0,0 +1,201 @@
+// DESCRIPTION: Verilator: Verilog example module
+//
+// This file ONLY is placed under the Creative Commons Public Domain, for
+// any use, without warranty, 2017 by Wilson Snyder.
+// SPDX-License-Identifier: CC0-1.0
+//======================================================================
+// Lockstep differential test of top against TopModel (top_model.h).
+//
+// Random button play (mode changes, drum presses, step keys, the odd
+// reset) is applied to Vtop and to the model on the same hz2m cycle, and
+// every output is compared after every cycle.  The first divergence stops
+// the run: the ports of both are printed side by side with the model's
+// internal state and the recent stimulus, and a short FST window around it
+// is written by the tracer (top_trace.h), by default the 512 cycles before
+// and 64 after into lockstep.fst.  Any +trace* plusarg replaces that
+// default.
+//
+//   +cycles=N   hz2m cycles to run (default 10000000)
+//   +seed=N     stimulus seed (default 1)
+//   +mod_m=N    hz2m cycles per hz100 half period (default 10000); smaller
+//               values step the sequencer faster in PLAY mode
+//======================================================================
+// Include common routines
+#include <verilated.h>
+
+// Shared harness: clocking, checks and reporting
+#include "top_harness.h"
+
+// C++ reference model, and the .mem loader for its ROMs
+#include "top_model.h"
+#include "mem_image.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+// Every output of top, read the same way from Vtop and TopModel.
+struct Ports {
+  uint8_t v[16];
+
+  template <class M>
+  explicit Ports(const M* m)
+      : v{m->left, m->right, m->ss7, m->ss6, m->ss5, m->ss4, m->ss3, m->ss2, m->ss1, m->ss0,
+          m->red, m->green, m->blue, m->txdata, m->txclk, m->rxclk} {}
+  bool operator==(const Ports& o) const { return !memcmp(v, o.v, sizeof(v)); }
+};
+static const char* PORT_NAMES[] = {"left", "right", "ss7", "ss6", "ss5", "ss4", "ss3", "ss2", "ss1",
+                                   "ss0", "red", "green", "blue", "txdata", "txclk", "rxclk"};
+
+// Random button play.  Each event holds one input pattern for a
+// log-uniform number of cycles, so there are both glitch-length presses
+// and holds long enough to hear several samples or sequencer steps.
+class Stimulus {
+public:
+  struct Event {
+    uint64_t cycle;
+    uint32_t pb;
+    uint8_t reset;
+  };
+
+  explicit Stimulus(unsigned seed) : rng_(seed) {}
+
+  Event next(uint64_t cycle) {
+    Event e = {cycle, 0, 0};
+    unsigned r = rng_() % 100;
+    if (r < 1)
+      e.reset = 1;
+    else if (r < 11)
+      e.pb = 1u << (r < 5 ? TO_EDIT : r < 8 ? TO_PLAY : TO_RAW);
+    else if (r < 56)
+      e.pb = rng_() % 15 + 1; // any mix of the drum keys
+    else if (r < 71)
+      e.pb = 1u << (r < 63 ? 8 : 11); // go_right, go_left
+    else if (r < 75)
+      e.pb = rng_() & 0xfffff; // anything at all
+    // else all released
+    return e;
+  }
+
+  uint64_t hold() {
+    double max = std::log(4.0 * MOD_M);
+    return 1 + uint64_t(std::exp(std::uniform_real_distribution<double>(0, max)(rng_)));
+  }
+
+private:
+  std::mt19937 rng_;
+};
+
+static void print_diff(Vtop* top, TopModel* model, uint64_t cycle, const std::deque<Stimulus::Event>& history) {
+  Ports a(top), b(model);
+  print_header("Divergence at hz2m cycle " + std::to_string(cycle), 70);
+  printf("%-8s %10s %10s\n", "port", "Vtop", "model");
+  for (int i = 0; i < 16; i++)
+    printf("%-8s %10s %10s%s\n", PORT_NAMES[i], padbin(a.v[i], 8).c_str(), padbin(b.v[i], 8).c_str(),
+           a.v[i] != b.v[i] ? "   <--" : "");
+
+  const char* modes[] = {"EDIT", "PLAY", "RAW"};
+  printf("\nmodel: mode %s, step %s (index %d), duty %d\n", modes[model->mode()],
+         padbin(model->step(), 8).c_str(), prienc8to3_ref(model->step()), model->duty());
+  printf("model: pattern (kick clap hihat snare per step)");
+  for (int s = 0; s < 8; s++)
+    printf(" %s", padbin(model->pattern() >> (4 * s) & 0xf, 4).c_str());
+  printf("\n\nlast stimulus:\n");
+  for (const Stimulus::Event& e : history)
+    printf("  cycle %10llu  pb %s%s\n", (unsigned long long)e.cycle, padbin(e.pb, 21).c_str(),
+           e.reset ? "  reset" : "");
+}
+
+int main(int argc, char **argv, char **env)
+{
+  // Prevent unused variable warnings
+  if (0 && argc && argv && env) {}
+
+  uint64_t cycles = 10000000;
+  unsigned seed = 1;
+  uint64_t post = 64;
+  bool traced = false;
+  std::vector<char*> args(argv, argv + argc);
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (!arg.compare(0, 8, "+cycles="))
+      cycles = std::strtoull(arg.c_str() + 8, NULL, 0);
+    else if (!arg.compare(0, 6, "+seed="))
+      seed = std::strtoul(arg.c_str() + 6, NULL, 0);
+    else if (!arg.compare(0, 7, "+mod_m="))
+      MOD_M = std::strtoul(arg.c_str() + 7, NULL, 0);
+    else if (!arg.compare(0, 12, "+trace_post="))
+      post = std::strtoull(arg.c_str() + 12, NULL, 0);
+    if (!arg.compare(0, 6, "+trace"))
+      traced = true;
+  }
+  static char trace_on[] = "+trace_on=mismatch", trace_pre[] = "+trace_pre=512",
+              trace_post[] = "+trace_post=64", trace_file[] = "+trace_file=lockstep.fst";
+  if (!traced)
+    args.insert(args.end(), {trace_on, trace_pre, trace_post, trace_file});
+
+  Verilated::debug(0);
+  Verilated::randReset(2);
+  Verilated::traceEverOn(true);
+  Verilated::commandArgs(args.size(), args.data());
+
+  std::array<std::vector<uint8_t>, 4> roms;
+  const char* drums[] = {"kick", "clap", "hihat", "snare"};
+  for (int d = 0; d < 4; d++)
+    roms[d] = load_mem(std::string("../audio/") + drums[d] + ".mem", 4096);
+
+  Vtop *top = new Vtop;
+  TopModel *model = new TopModel(roms);
+  top_harness_init(top, args.size(), args.data());
+
+  Stimulus stim(seed);
+  std::deque<Stimulus::Event> history;
+  // both start with a reset, as top.cpp does
+  Stimulus::Event event = {0, 0, 1};
+  uint64_t next_event = 0;
+  uint64_t diverged = ~0ull;
+
+  print_header("Lockstep: seed " + std::to_string(seed) + ", " + std::to_string(cycles) + " cycles", 70);
+  for (uint64_t cycle = 0; cycle < cycles; cycle++) {
+    if (cycle == next_event) {
+      top->pb = model->pb = event.pb;
+      top->reset = model->reset = event.reset;
+      history.push_back(event);
+      if (history.size() > 8)
+        history.pop_front();
+      next_event = cycle + (event.reset ? 5 : stim.hold());
+      event = stim.next(next_event);
+    }
+    cycle_clocks(top, 1);
+    model->run(1);
+    if (model->hz100 != top->hz100) {
+      model->hz100 = top->hz100;
+      model->eval();
+    }
+    if (diverged == ~0ull && !(Ports(top) == Ports(model))) {
+      diverged = cycle;
+      tracer->mismatch();
+      print_diff(top, model, cycle, history);
+      cycles = std::min(cycles, cycle + 1 + post);
+    }
+  }
+
+  if (diverged == ~0ull)
+    update_tests(1, 1, "lockstep, " + std::to_string(cycles) + " cycles", "");
+  else
+    update_tests(0, 1, "lockstep, diverged at cycle " + std::to_string(diverged), "");
+  int result = report_tests();
+
+  top->final();
+  top_harness_final();
+  delete top;
+  top = NULL;
+  delete model;
+  model = NULL;
+  return result;
+}
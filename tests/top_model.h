@@ -0,0 +1,383 @@
+// Cycle-accurate C++ reference model of the drum machine's top module.
+//
+// TopModel has the same ports as Vtop (pb, reset, hz2m/hz100 in; left,
+// right, ss7..ss0, red/green/blue out) and the same eval() contract:
+// poke inputs, call eval(), read outputs, with flops updating on rising
+// edges of their clocks and resets acting asynchronously.  It is composed
+// of one model per module, each matching what that module's test in
+// tests/ requires:
+//
+//   scankey      out = index of the pressed key; strobe = |pb[19:0]
+//                through two hz2m flops
+//   controller   EDIT/PLAY/RAW, clocked by strobe; set_edit > set_play >
+//                set_raw
+//   clkdiv       hzX toggles every lim+1 clock edges
+//   sequencer    one-hot step, 0x80 on reset, rotates on go_left/go_right
+//   prienc8to3   sequencer step -> set_time_idx
+//   sequence_editor  in EDIT, strobe XORs tgl_play_smpl into the step's
+//                four drum bits
+//   sample       ROM player, addresses 0..SAMPLE_LAST, two-cycle read
+//                latency, rst holds it at the start of the sample
+//   pwm          8-bit counter; pwm_out = counter <= duty_cycle
+//
+// top.sv in this tree is still an empty shell, so the wiring between the
+// modules is the reference wiring below.  Top designs that are compared
+// against the model (see top_lockstep) are expected to follow it.  The
+// limits and lengths it needs are assumptions, kept together as the
+// constants at the start of namespace top_model.
+//
+//   key strobe       scankey(pb[19:0]) on hz2m
+//   mode             controller(strobe; set_edit=pb[19], set_play=pb[18],
+//                    set_raw=pb[16]); blue/green/red = EDIT/PLAY/RAW
+//   beat             clkdiv(hz100, lim=BEAT_LIM)
+//   step             sequencer, clocked by beat in PLAY (go_right) and by
+//                    strobe otherwise (go_left=pb[11], go_right=pb[8]);
+//                    left = step
+//   pattern          sequence_editor(strobe, mode, prienc8to3(step),
+//                    tgl_play_smpl=pb[3:0])
+//   voices           sample x4 (bit 3 kick, 2 clap, 1 hihat, 0 snare) on
+//                    hz8k = clkdiv(hz2m, lim=HZ8K_LIM), each up to
+//                    SAMPLE_LAST; a voice plays while its pb bit is held
+//                    in RAW, or while its pattern bit is set for the
+//                    current step in PLAY, and is held in reset otherwise
+//   mix              duty = saturate(sum of the four signed voices) + 128
+//   audio            pwm(hz2m, enable=1, duty); right[0] = pwm_out
+//   ss7..ss0, UART   driven to 0
+//
+// Besides eval(), run(n) advances n whole hz2m cycles, as top_harness's
+// cycle_clocks() does without the hz100 toggle.  Once the key strobe has
+// settled nothing but the pwm counter and the 8 kHz voices can change, so
+// it steps from one hz8k edge to the next in O(1); with a PwmDemod it also
+// delivers right[0] for every cycle, a word at a time.
+//======================================================================
+#ifndef DRUM_MACHINE_TOP_MODEL_H
+#define DRUM_MACHINE_TOP_MODEL_H
+
+#include "pwm_demod.h"
+#include "ref_tables.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace top_model {
+
+enum Mode : uint8_t { EDIT = 0, PLAY = 1, RAW = 2 };
+
+// Assumed by the reference wiring, since no top.sv in this tree fixes
+// them yet.  A top that chooses differently changes them here.
+//
+// clkdiv limit of the PLAY tempo on hz100, the default of TopModel's
+// beat_lim: a step every 2 * 13 hz100 cycles.
+static const uint8_t BEAT_LIM = 12;
+// clkdiv limit of the voices' clock on hz2m: hz8k = 2 MHz / 256.
+static const uint8_t HZ8K_LIM = 127;
+// Last address of every voice's ROM before it wraps, the same for all
+// four (see tests/sample.cpp).
+static const unsigned SAMPLE_LAST = 4000;
+
+struct Clkdiv {
+  uint8_t lim;
+  uint8_t count = 0;
+  uint8_t hzX = 0;
+
+  explicit Clkdiv(uint8_t l) : lim(l) {}
+  void reset() { count = 0; hzX = 0; }
+  void edge() {
+    if (count >= lim) {
+      count = 0;
+      hzX ^= 1;
+    }
+    else {
+      count++;
+    }
+  }
+};
+
+struct Sequencer {
+  uint8_t seq_out = 0x80;
+
+  void reset() { seq_out = 0x80; }
+  void edge(bool srst, bool go_left, bool go_right) {
+    if (srst)
+      seq_out = 0x80;
+    else if (go_left)
+      seq_out = uint8_t(seq_out << 1 | seq_out >> 7);
+    else if (go_right)
+      seq_out = uint8_t(seq_out >> 1 | seq_out << 7);
+  }
+};
+
+struct SequenceEditor {
+  uint32_t seq_smpl = 0; // seq_smpl_1 in bits 3:0 ... seq_smpl_8 in 31:28
+
+  void reset() { seq_smpl = 0; }
+  void edge(uint8_t mode, uint8_t set_time_idx, uint8_t tgl_play_smpl) {
+    if (mode == EDIT)
+      seq_smpl ^= uint32_t(tgl_play_smpl & 0xf) << (set_time_idx * 4);
+  }
+  uint8_t step(uint8_t idx) const { return (seq_smpl >> (idx * 4)) & 0xf; }
+};
+
+struct Sample {
+  const std::vector<uint8_t>* rom = NULL;
+  uint16_t addr = 0;
+  uint8_t data = 0;
+  uint8_t out = 0;
+
+  uint8_t read(uint16_t a) const { return a < rom->size() ? (*rom)[a] : 0; }
+  void reset() {
+    addr = 0;
+    data = out = read(0);
+  }
+  void edge() {
+    out = data;
+    data = read(addr);
+    addr = addr == SAMPLE_LAST ? 0 : addr + 1;
+  }
+};
+
+struct Pwm {
+  uint8_t counter = 0;
+
+  void reset() { counter = 0; }
+  void edge() { counter++; }
+  uint8_t out(uint8_t duty) const { return counter <= duty; }
+};
+
+} // namespace top_model
+
+class TopModel {
+public:
+  // inputs
+  uint8_t hz2m = 0, hz100 = 0, reset = 0;
+  uint32_t pb = 0;
+  uint8_t rxdata = 0, txready = 0, rxready = 0;
+  // outputs
+  uint8_t left = 0, right = 0;
+  uint8_t ss7 = 0, ss6 = 0, ss5 = 0, ss4 = 0, ss3 = 0, ss2 = 0, ss1 = 0, ss0 = 0;
+  uint8_t red = 0, green = 0, blue = 0;
+  uint8_t txdata = 0, txclk = 0, rxclk = 0;
+
+  // roms: kick, clap, hihat, snare images (signed 8-bit, as in audio/).
+  // beat_lim: clkdiv limit for the PLAY tempo on hz100.
+  explicit TopModel(const std::array<std::vector<uint8_t>, 4>& roms, uint8_t beat_lim = top_model::BEAT_LIM)
+      : roms_(roms), beat_(beat_lim), hz8k_(top_model::HZ8K_LIM) {
+    for (int d = 0; d < 4; d++)
+      voice_[d].rom = &roms_[3 - d]; // voice bit 3 is kick
+    reset_all();
+    outputs();
+  }
+
+  // The voices point into roms_, so a copy would play the original's.
+  TopModel(const TopModel&) = delete;
+  TopModel& operator=(const TopModel&) = delete;
+
+  void eval() {
+    using namespace top_model;
+    bool hz2m_rise = hz2m && !last_hz2m_;
+    bool hz100_rise = hz100 && !last_hz100_;
+    last_hz2m_ = hz2m;
+    last_hz100_ = hz100;
+
+    if (reset) {
+      reset_all();
+    }
+    else {
+      if (hz2m_rise) {
+        // scankey synchroniser, hz8k divider and pwm share hz2m
+        strobe_ = sync_;
+        sync_ = (pb & 0xfffff) != 0;
+        hz8k_.edge();
+        pwm_.edge();
+      }
+      if (hz100_rise)
+        beat_.edge();
+      settle();
+    }
+    outputs();
+  }
+
+  // n cycles of hz2m (fall, then rise), as cycle_clocks() in top_harness.h
+  // without the hz100 toggle.  If demod is given, right[0] after every
+  // rising edge is pushed to it.
+  void run(uint64_t n, PwmDemod* demod = NULL) {
+    while (n) {
+      if (quiet()) {
+        fast_forward(n, demod);
+        return;
+      }
+      hz2m = 0;
+      eval();
+      hz2m = 1;
+      eval();
+      if (demod)
+        demod->push(right & 1);
+      n--;
+    }
+  }
+
+  uint8_t mode() const { return mode_; }
+  uint8_t step() const { return seq_.seq_out; }
+  uint32_t pattern() const { return editor_.seq_smpl; }
+  uint8_t duty() const { return duty_; }
+
+private:
+  void reset_all() {
+    sync_ = strobe_ = 0;
+    mode_ = top_model::EDIT;
+    beat_.reset();
+    hz8k_.reset();
+    seq_.reset();
+    editor_.reset();
+    for (auto& v : voice_)
+      v.reset();
+    pwm_.reset();
+    last_strobe_ = last_seq_clk_ = last_hz8k_ = 0;
+    update_play();
+  }
+
+  uint8_t seq_clk() const { return mode_ == top_model::PLAY ? beat_.hzX : strobe_; }
+
+  // Which voices are out of reset.
+  void update_play() {
+    using namespace top_model;
+    if (mode_ == RAW)
+      play_ = pb & 0xf;
+    else if (mode_ == PLAY)
+      play_ = editor_.step(prienc8to3_ref(seq_.seq_out));
+    else
+      play_ = 0;
+    for (int d = 0; d < 4; d++)
+      if (!(play_ >> d & 1))
+        voice_[d].reset();
+  }
+
+  // Clocks the domains of every derived clock that rose, all from the
+  // values before the edge, until nothing else rises.
+  void settle() {
+    using namespace top_model;
+    for (int pass = 0; pass < 4; pass++) {
+      update_play();
+      bool strobe_rise = strobe_ && !last_strobe_;
+      uint8_t sclk = seq_clk();
+      bool seq_rise = sclk && !last_seq_clk_;
+      bool hz8k_rise = hz8k_.hzX && !last_hz8k_;
+      last_strobe_ = strobe_;
+      last_seq_clk_ = sclk;
+      last_hz8k_ = hz8k_.hzX;
+      if (!strobe_rise && !seq_rise && !hz8k_rise)
+        break;
+
+      uint8_t mode = mode_;
+      uint8_t idx = prienc8to3_ref(seq_.seq_out);
+      if (strobe_rise) {
+        if (pb >> 19 & 1)
+          mode_ = EDIT;
+        else if (pb >> 18 & 1)
+          mode_ = PLAY;
+        else if (pb >> 16 & 1)
+          mode_ = RAW;
+        editor_.edge(mode, idx, pb & 0xf);
+      }
+      if (seq_rise) {
+        if (mode == PLAY)
+          seq_.edge(false, false, true);
+        else
+          seq_.edge(false, pb >> 11 & 1, pb >> 8 & 1);
+      }
+      if (hz8k_rise)
+        for (int d = 0; d < 4; d++)
+          if (play_ >> d & 1)
+            voice_[d].edge();
+    }
+    update_play();
+  }
+
+  void outputs() {
+    using namespace top_model;
+    int sum = 0;
+    for (auto& v : voice_)
+      sum += int8_t(v.out);
+    sum = sum > 127 ? 127 : sum < -128 ? -128 : sum;
+    duty_ = uint8_t(sum + 128);
+    right = pwm_.out(duty_);
+    left = seq_.seq_out;
+    red = mode_ == RAW;
+    green = mode_ == PLAY;
+    blue = mode_ == EDIT;
+  }
+
+  // Whether hz2m cycles can be run in bulk: with the key synchroniser
+  // settled and reset low, only the pwm counter, the hz8k divider and, on
+  // its rising edges, the playing voices move.
+  bool quiet() const {
+    return !reset && strobe_ == sync_ && sync_ == ((pb & 0xfffff) != 0);
+  }
+
+  // right[0] for the next len cycles at the current duty: after each edge
+  // it is (counter + i + 1) <= duty.
+  void emit(uint64_t len, PwmDemod* demod) const {
+    unsigned c = uint8_t(pwm_.counter + 1);
+    while (len) {
+      unsigned n = len < 64 ? unsigned(len) : 64;
+      if (n > 256 - c)
+        n = 256 - c; // up to the counter wrap
+      int ones = int(duty_) - int(c) + 1;
+      ones = ones < 0 ? 0 : ones > int(n) ? int(n) : ones;
+      demod->push_word(ones == 64 ? ~0ull : (1ull << ones) - 1, n);
+      c = (c + n) & 255;
+      len -= n;
+    }
+  }
+
+  void fast_forward(uint64_t n, PwmDemod* demod) {
+    // the first fall of hz2m evaluates any change on pb's drum bits
+    update_play();
+    outputs();
+    while (n) {
+      // up to, not including, the edge on which hz8k toggles
+      uint64_t k = hz8k_.count >= hz8k_.lim ? 0 : hz8k_.lim - hz8k_.count;
+      if (k > n)
+        k = n;
+      if (demod && k)
+        emit(k, demod);
+      pwm_.counter += uint8_t(k);
+      hz8k_.count += uint8_t(k);
+      n -= k;
+      if (!n)
+        break;
+      // the toggle edge itself
+      pwm_.edge();
+      hz8k_.edge();
+      if (hz8k_.hzX)
+        for (int d = 0; d < 4; d++)
+          if (play_ >> d & 1)
+            voice_[d].edge();
+      last_hz8k_ = hz8k_.hzX;
+      outputs();
+      if (demod)
+        demod->push(right & 1);
+      n--;
+    }
+    // hz2m ends high, as after a cycle; its last rise is already consumed
+    hz2m = 1;
+    last_hz2m_ = 1;
+    outputs();
+  }
+
+  std::array<std::vector<uint8_t>, 4> roms_;
+
+  uint8_t last_hz2m_ = 0, last_hz100_ = 0;
+  uint8_t sync_ = 0, strobe_ = 0;
+  uint8_t mode_ = top_model::EDIT;
+  top_model::Clkdiv beat_, hz8k_;
+  top_model::Sequencer seq_;
+  top_model::SequenceEditor editor_;
+  top_model::Sample voice_[4];
+  top_model::Pwm pwm_;
+  uint8_t play_ = 0, duty_ = 128;
+  uint8_t last_strobe_ = 0, last_seq_clk_ = 0, last_hz8k_ = 0;
+};
+
+#endif
@@ -0,0 +1,144 @@
+// DESCRIPTION: Verilator: Verilog example module
+//
+// This file ONLY is placed under the Creative Commons Public Domain, for
+// any use, without warranty, 2017 by Wilson Snyder.
+// SPDX-License-Identifier: CC0-1.0
+//======================================================================
+// Runs a scenario file (see scenario.h) on top.
+//
+// The file is parsed once into a queue of events sorted by time; the run
+// then steps top straight from one event to the next with cycle_clocks(),
+// and only cycles inside a capture are stepped one at a time to read
+// right[0].  Each expect is reported as a test, so new regression scenarios
+// need a new file, not a new harness.
+//
+//   +scenario=file   the scenario to run (required)
+//   +mod_m=N         hz2m cycles per hz100 half period (default 10000)
+//   +demod*          PWM to PCM filter for captures (see pwm_demod.h)
+//   +trace*          as for top.cpp (see top_trace.h)
+//======================================================================
+// Include common routines
+#include <verilated.h>
+
+// Shared harness: clocking, checks and reporting
+#include "top_harness.h"
+
+#include "audio_sink.h"
+#include "pwm_demod.h"
+#include "scenario.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// A capture in progress: the demodulator, the PCM so far and how many
+// samples are still owed.
+struct Capture {
+  std::string name;
+  uint64_t remaining = 0;
+  std::vector<int16_t> pcm;
+};
+
+// Steps n cycles, reading right[0] every cycle while a capture is open and
+// writing the capture out once it has all its samples.
+static void advance(Vtop* top, uint64_t n, PwmDemod& demod, Capture& capture) {
+  if (!capture.remaining) {
+    cycle_clocks(top, n);
+    return;
+  }
+  for (uint64_t i = 0; i < n; i++) {
+    cycle_clocks(top, 1);
+    demod.push(top->right & 0x1);
+  }
+  size_t before = capture.pcm.size();
+  demod.decode(capture.pcm);
+  capture.remaining -= std::min<uint64_t>(capture.remaining, capture.pcm.size() - before);
+  if (!capture.remaining) {
+    WavSink wav(capture.name + ".wav", HZ2M / demod.window());
+    wav.write(capture.pcm.data(), capture.pcm.size());
+    capture.pcm.clear();
+  }
+}
+
+int main(int argc, char **argv, char **env)
+{
+  // Prevent unused variable warnings
+  if (0 && argc && argv && env) {}
+
+  Verilated::debug(0);
+  Verilated::randReset(2);
+  Verilated::traceEverOn(true);
+  Verilated::commandArgs(argc, argv);
+
+  std::string file = plusarg("scenario", "");
+  MOD_M = std::strtoul(plusarg("mod_m", std::to_string(MOD_M)).c_str(), NULL, 0);
+  if (file.empty()) {
+    printf("top_scenario: no +scenario=file given\n");
+    return EXIT_FAILURE;
+  }
+
+  PwmDemod demod(argc, argv);
+  std::vector<ScenarioEvent> events = parse_scenario(file, {2ull * MOD_M, demod.window()});
+  std::string suite = file.substr(file.find_last_of('/') + 1);
+  print_header("Scenario " + suite + ": " + std::to_string(events.size()) + " events", 70);
+
+  Vtop *top = new Vtop;
+  top_harness_init(top, argc, argv);
+
+  static const char* modes[] = {"edit", "play", "raw"};
+  Capture capture;
+  uint64_t now = 0;
+  for (const ScenarioEvent& e : events) {
+    advance(top, e.cycle - now, demod, capture);
+    now = e.cycle;
+    std::string where = file + ":" + std::to_string(e.line) + ": ";
+    switch (e.kind) {
+      case ScenarioEvent::WAIT:
+        break;
+      case ScenarioEvent::PRESS:
+        top->pb |= e.keys;
+        break;
+      case ScenarioEvent::RELEASE:
+        top->pb &= ~e.keys;
+        break;
+      case ScenarioEvent::RESET_ON:
+        top->reset = 1;
+        break;
+      case ScenarioEvent::RESET_OFF:
+        top->reset = 0;
+        break;
+      case ScenarioEvent::CAPTURE:
+        demod.reset();
+        capture.name = e.name;
+        capture.remaining = e.count;
+        break;
+      case ScenarioEvent::EXPECT_MODE: {
+        top->eval();
+        uint8_t lamps = (top->red << 2) | (top->green << 1) | top->blue;
+        bool ok = lamps == (e.value == 0 ? 1 : e.value == 1 ? 2 : 4);
+        if (!ok)
+          tracer->mismatch();
+        update_tests(ok, 1, std::string("mode ") + modes[e.value] + " at cycle " + std::to_string(now), where);
+        break;
+      }
+      case ScenarioEvent::EXPECT_STEP: {
+        top->eval();
+        bool ok = top->left == (0x80 >> e.value);
+        if (!ok)
+          tracer->mismatch();
+        update_tests(ok, 1, "step " + std::to_string(e.value) + " at cycle " + std::to_string(now) + " (left " +
+                                padbin(top->left, 8) + ")", where);
+        break;
+      }
+    }
+  }
+
+  int result = report_tests();
+
+  top->final();
+  top_harness_final();
+  delete top;
+  top = NULL;
+  return result;
+}
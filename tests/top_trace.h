@@ -0,0 +1,273 @@
+// Windowed and triggered FST tracing for the top testbench.
+//
+// Dumping every hz2m edge of a full render makes top.fst huge and the
+// simulation several times slower, so tracing is off unless asked for:
+//
+//   +trace                        trace the whole run
+//   +trace_start=N +trace_stop=M  trace hz2m cycles [N, M)
+//   +trace_on=pb,mode,mismatch    start tracing at the first pb change, mode
+//                                 lamp (red/green/blue) change, or failed check
+//   +trace_pre=N                  with +trace_on, also keep the N cycles
+//                                 leading up to the trigger (default 0);
+//                                 until the trigger fires this simulates
+//                                 a second Vtop, so the run takes about
+//                                 twice as long
+//   +trace_post=N                 with +trace_on, cycles traced after the
+//                                 trigger (default 100000)
+//   +trace_file=name              output file (default top.fst)
+//
+// An FST cannot be dumped after the fact, so the pre-trigger history is
+// kept by a shadow Vtop that replays the same stimulus N cycles behind the
+// real model, clocked by a ClockScheduler of its own set up like top's
+// (top_harness.h), so both see the same edges.  Only the shadow is traced; once the trigger window has been
+// written the shadow is dropped and the run continues at full speed.
+// This relies on the model being deterministic, i.e. built with
+// --x-initial 0 as playaudio does.
+//======================================================================
+#ifndef DRUM_MACHINE_TOP_TRACE_H
+#define DRUM_MACHINE_TOP_TRACE_H
+
+#include <verilated.h>
+#include "verilated_fst_c.h"
+#include "clock_scheduler.h"
+#include "Vtop.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TopTracer {
+public:
+  enum Trigger { TRIG_PB = 1, TRIG_MODE = 2, TRIG_MISMATCH = 4 };
+
+  // hz100_ratio is the hz2m rising edges per hz100 cycle, as top is
+  // clocked with; the shadow is clocked the same way.
+  TopTracer(Vtop* top, uint64_t hz100_ratio, int argc, char** argv) : top_(top) {
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "+trace")
+        start_ = 0;
+      else if (!arg.compare(0, 13, "+trace_start="))
+        start_ = std::strtoull(arg.c_str() + 13, NULL, 0);
+      else if (!arg.compare(0, 12, "+trace_stop="))
+        stop_ = std::strtoull(arg.c_str() + 12, NULL, 0);
+      else if (!arg.compare(0, 11, "+trace_pre="))
+        pre_ = std::strtoull(arg.c_str() + 11, NULL, 0);
+      else if (!arg.compare(0, 12, "+trace_post="))
+        post_ = std::strtoull(arg.c_str() + 12, NULL, 0);
+      else if (!arg.compare(0, 12, "+trace_file="))
+        filename_ = arg.substr(12);
+      else if (!arg.compare(0, 10, "+trace_on=")) {
+        std::string on = "," + arg.substr(10) + ",";
+        if (on.find(",pb,") != std::string::npos) armed_ |= TRIG_PB;
+        if (on.find(",mode,") != std::string::npos) armed_ |= TRIG_MODE;
+        if (on.find(",mismatch,") != std::string::npos) armed_ |= TRIG_MISMATCH;
+      }
+    }
+    if (armed_ && pre_) {
+      // The shadow starts from the same power-on state as top.
+      shadow_context_.reset(new VerilatedContext);
+      shadow_context_->randReset(2);
+      shadow_ = new Vtop(shadow_context_.get());
+      shadow_->hz2m = 0;
+      shadow_->hz100 = 0;
+      shadow_->reset = 0;
+      shadow_->pb = 0;
+      shadow_->eval();
+      shadow_context_->timeInc(1);
+      shadow_clocks_.reset(new ClockScheduler<Vtop, ShadowHook>(shadow_, shadow_context_.get(), ShadowHook{this}));
+      shadow_hz2m_ = shadow_clocks_->add(shadow_->hz2m, 2, 1);
+      shadow_hz100_ = shadow_clocks_->divide(shadow_->hz100, shadow_hz2m_, hz100_ratio);
+      ring_.resize(pre_);
+      open(shadow_);
+    }
+    else if (armed_ || start_ != NEVER) {
+      open(top_);
+    }
+    on_ = start_ == 0;
+    idle_ = !armed_ && (start_ == NEVER || (start_ == 0 && stop_ == NEVER));
+    last_pb_ = top_->pb;
+  }
+
+  ~TopTracer() {
+    finish();
+    shadow_clocks_.reset();
+    delete shadow_;
+  }
+
+  // Called after every hz2m edge of top.
+  inline void dump(uint64_t time) {
+    if (on_ && !shadow_)
+      tfp_.dump(time);
+  }
+
+  // True while cycle() has nothing to do but count, i.e. tracing is off or
+  // covers the whole run; cycle_clocks() then steps in bulk and calls
+  // skip() instead.
+  inline bool idle() const { return idle_; }
+  inline void skip(uint64_t n) { cycle_ += n; }
+
+  // Called once per hz2m cycle of top, after the cycle (and any hz100
+  // toggle) has been evaluated.
+  inline void cycle() {
+    cycle_++;
+    if (idle_)
+      return;
+    if (start_ != NEVER) {
+      on_ = cycle_ >= start_ && cycle_ < stop_;
+      if (cycle_ >= stop_)
+        stop();
+      return;
+    }
+    if (armed_) {
+      uint8_t mode = (top_->red << 2) | (top_->green << 1) | top_->blue;
+      // reset itself moves the lamps to EDIT, which is not interesting
+      if ((armed_ & TRIG_PB) && top_->pb != last_pb_)
+        trigger("pb change");
+      else if ((armed_ & TRIG_MODE) && mode != last_mode_ && !top_->reset)
+        trigger("mode change");
+      last_pb_ = top_->pb;
+      last_mode_ = mode;
+    }
+    if (shadow_)
+      shadow_cycle();
+    if (triggered_at_ != NEVER && cycle_ >= triggered_at_ + post_)
+      stop();
+  }
+
+  // A check failed; starts the trace if mismatches are a trigger.
+  void mismatch() {
+    if (armed_ & TRIG_MISMATCH)
+      trigger("mismatch");
+  }
+
+  // Whether a trace file is open, i.e. some tracing was asked for.
+  bool tracing() const { return tfp_.isOpen(); }
+
+  // hz2m cycles of top so far.
+  uint64_t cycles() const { return cycle_; }
+
+  // top was just restored from a checkpoint taken at hz2m cycle `cycle`,
+  // with hz100_count hz2m rises since hz100 last toggled
+  // (top_checkpoint.h).  Trace windows count from there on, and the
+  // shadow, if any, is handed to load(shadow, context) to be restored from
+  // the same checkpoint so it keeps replaying the same history as top.
+  template <class Load>
+  void restored(uint64_t cycle, uint64_t hz100_count, Load load) {
+    cycle_ = cycle;
+    last_pb_ = top_->pb;
+    last_mode_ = (top_->red << 2) | (top_->green << 1) | top_->blue;
+    if (start_ != NEVER)
+      on_ = cycle_ >= start_ && cycle_ < stop_;
+    if (shadow_) {
+      load(shadow_, shadow_context_.get());
+      shadow_clocks_->set_count(shadow_hz100_, hz100_count);
+      shadow_clocks_->restart();
+    }
+  }
+
+  // Flushes whatever the shadow still owes the trace and closes the file.
+  void finish() {
+    if (shadow_ && on_)
+      while (ring_count_)
+        shadow_step(ring_[pop()]);
+    if (tfp_.isOpen())
+      tfp_.close();
+    on_ = false;
+    idle_ = true;
+  }
+
+private:
+  static const uint64_t NEVER = ~0ull;
+
+  // Stimulus of one hz2m cycle, as applied to top at its falling edge.
+  struct Stim {
+    uint32_t pb;
+    uint8_t reset;
+  };
+
+  // Dumps the shadow's edges while the trace is on.
+  struct ShadowHook {
+    TopTracer* tracer;
+    inline void operator()(uint64_t time) {
+      if (tracer->on_)
+        tracer->tfp_.dump(time);
+    }
+  };
+
+  void open(Vtop* model) {
+    model->trace(&tfp_, 9);
+    tfp_.open(filename_.c_str());
+  }
+
+  void trigger(const char* why) {
+    if (triggered_at_ != NEVER)
+      return;
+    triggered_at_ = cycle_;
+    armed_ = 0;
+    on_ = true;
+    std::cout << "[trace] " << why << " at hz2m cycle " << cycle_ << ", tracing "
+              << std::min<uint64_t>(pre_, cycle_) << " cycles before and " << post_ << " after\n";
+  }
+
+  void stop() {
+    finish();
+    shadow_clocks_.reset();
+    delete shadow_;
+    shadow_ = NULL;
+  }
+
+  inline size_t pop() {
+    size_t i = ring_head_;
+    ring_head_ = (ring_head_ + 1) % ring_.size();
+    ring_count_--;
+    return i;
+  }
+
+  // Queue this cycle's stimulus; once the ring is full the shadow runs the
+  // oldest entry so it stays exactly pre_ cycles behind.
+  inline void shadow_cycle() {
+    // pb/reset were already applied by the falling edge of this cycle.
+    Stim s = {top_->pb, top_->reset};
+    if (ring_count_ == ring_.size())
+      shadow_step(ring_[pop()]);
+    ring_[(ring_head_ + ring_count_) % ring_.size()] = s;
+    ring_count_++;
+  }
+
+  // One hz2m cycle of the shadow, as cycle_clocks() (top_harness.h) runs
+  // one of top; hz100 follows from the shadow's own divider.
+  inline void shadow_step(const Stim& s) {
+    shadow_->pb = s.pb;
+    shadow_->reset = s.reset;
+    shadow_clocks_->step(shadow_hz2m_);
+  }
+
+  Vtop* top_;
+  VerilatedFstC tfp_;
+  std::string filename_ = "top.fst";
+
+  uint64_t cycle_ = 0;
+  uint64_t start_ = NEVER, stop_ = NEVER;
+  uint64_t pre_ = 0, post_ = 100000;
+  uint64_t triggered_at_ = NEVER;
+  unsigned armed_ = 0;
+  bool on_ = false;
+  bool idle_ = true;
+
+  uint32_t last_pb_ = 0;
+  uint8_t last_mode_ = 0;
+
+  std::unique_ptr<VerilatedContext> shadow_context_;
+  Vtop* shadow_ = NULL;
+  std::unique_ptr<ClockScheduler<Vtop, ShadowHook>> shadow_clocks_;
+  int shadow_hz2m_ = -1, shadow_hz100_ = -1;
+  std::vector<Stim> ring_;
+  size_t ring_head_ = 0, ring_count_ = 0;
+};
+
+#endif
@@ -0,0 +1,299 @@
+// samplebank: compiles drum samples into one packed ROM image.
+//
+//   samplebank [options] -o <bank> name=file [name=file ...]
+//
+// Each file is a .wav (8/16/24/32-bit PCM or 32-bit float, any channel
+// count, mixed down to mono) or an existing signed 8-bit .mem image.
+// WAV input is resampled to --rate with a windowed-sinc filter, peak
+// normalised to --peak of full scale and quantised to signed 8 bits with
+// TPDF dither.  .mem input is taken as already being at --rate.
+//
+// Writes <bank>.mem, <bank>_index.mem (see tests/sample_bank.h) and
+// <bank>_index.svh with the same table as localparams for the RTL, named
+// <NAME>_START and <NAME>_LEN after each voice: upper-cased, with any
+// character not allowed in an identifier replaced by _ and a _ in front
+// of a leading digit.
+// With --adpcm each voice is stored as 4-bit IMA ADPCM (tests/adpcm.h),
+// which workdir/adpcm.sv decodes, in half the space.
+//
+//   --rate N      output sample rate in Hz (default 8000)
+//   --peak F      normalise WAV input so its peak is F of full scale;
+//                 0 keeps the original level (default 0.98)
+//   --dither D    tpdf or none (default tpdf)
+//   --seed N      dither seed, for reproducible images (default 1)
+//   --adpcm       store 4-bit ADPCM instead of raw 8-bit samples
+//======================================================================
+#include "sample_bank.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+static void usage() {
+  fprintf(stderr, "usage: samplebank [--rate N] [--peak F] [--dither tpdf|none] [--seed N] [--adpcm] -o <bank> name=file...\n");
+  exit(2);
+}
+
+[[noreturn]] static void die(const std::string& why) {
+  fprintf(stderr, "samplebank: %s\n", why.c_str());
+  exit(1);
+}
+
+static uint32_t le(const uint8_t* p, int bytes) {
+  uint32_t v = 0;
+  for (int i = bytes - 1; i >= 0; i--)
+    v = v << 8 | p[i];
+  return v;
+}
+
+// Mono samples in [-1, 1) and their rate.
+struct Audio {
+  std::vector<double> samples;
+  unsigned rate;
+};
+
+static Audio read_wav(const std::string& path) {
+  std::ifstream f(path, std::ios::binary);
+  std::vector<uint8_t> d((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+  if (d.size() < 12 || memcmp(&d[0], "RIFF", 4) || memcmp(&d[8], "WAVE", 4))
+    die(path + ": not a RIFF/WAVE file");
+
+  unsigned format = 0, channels = 0, rate = 0, bits = 0;
+  const uint8_t* data = NULL;
+  size_t data_len = 0;
+  for (size_t p = 12; p + 8 <= d.size();) {
+    uint32_t len = le(&d[p + 4], 4);
+    size_t body = p + 8;
+    if (body + len > d.size())
+      len = d.size() - body;
+    if (!memcmp(&d[p], "fmt ", 4) && len >= 16) {
+      format = le(&d[body], 2);
+      channels = le(&d[body + 2], 2);
+      rate = le(&d[body + 4], 4);
+      bits = le(&d[body + 14], 2);
+      if (format == 0xfffe && len >= 26) // WAVE_FORMAT_EXTENSIBLE: subformat GUID
+        format = le(&d[body + 24], 2);
+    }
+    else if (!memcmp(&d[p], "data", 4)) {
+      data = &d[body];
+      data_len = len;
+    }
+    p = body + len + (len & 1);
+  }
+  if (!data || !channels || !rate)
+    die(path + ": missing fmt or data chunk");
+  bool pcm = format == 1 && (bits == 8 || bits == 16 || bits == 24 || bits == 32);
+  bool flt = format == 3 && bits == 32;
+  if (!pcm && !flt)
+    die(path + ": unsupported format " + std::to_string(format) + "/" + std::to_string(bits) + " bits");
+
+  Audio a;
+  a.rate = rate;
+  int bytes = bits / 8;
+  size_t frames = data_len / (bytes * channels);
+  a.samples.resize(frames);
+  for (size_t i = 0; i < frames; i++) {
+    double sum = 0;
+    for (unsigned c = 0; c < channels; c++) {
+      const uint8_t* p = data + (i * channels + c) * bytes;
+      uint32_t raw = le(p, bytes);
+      double v;
+      if (flt) {
+        float x;
+        memcpy(&x, &raw, 4);
+        v = x;
+      }
+      else if (bits == 8) {
+        v = (int(raw) - 128) / 128.0; // 8-bit WAV is unsigned
+      }
+      else {
+        int32_t s = int32_t(raw << (32 - bits)) >> (32 - bits);
+        v = s / double(1u << (bits - 1));
+      }
+      sum += v;
+    }
+    a.samples[i] = sum / channels;
+  }
+  return a;
+}
+
+static double sinc(double x) {
+  return x == 0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+}
+
+// Band-limited resampling with a Blackman-windowed sinc, 16 zero
+// crossings each side, cut off just below the lower Nyquist frequency.
+static std::vector<double> resample(const std::vector<double>& in, unsigned from, unsigned to) {
+  if (from == to || in.empty())
+    return in;
+  const int zeros = 16;
+  double ratio = double(to) / from;
+  double cutoff = 0.95 * std::min(1.0, ratio);
+  double half = zeros / cutoff; // filter half-width in input samples
+  size_t n = size_t(std::ceil(in.size() * ratio));
+  std::vector<double> out(n);
+  for (size_t k = 0; k < n; k++) {
+    double t = k / ratio;
+    long lo = long(std::ceil(t - half)), hi = long(std::floor(t + half));
+    double acc = 0;
+    for (long j = std::max(lo, 0L); j <= std::min(hi, long(in.size()) - 1); j++) {
+      double x = j - t;
+      double w = 0.42 + 0.5 * std::cos(M_PI * x / half) + 0.08 * std::cos(2 * M_PI * x / half);
+      acc += in[j] * cutoff * sinc(cutoff * x) * w;
+    }
+    out[k] = acc;
+  }
+  return out;
+}
+
+struct Options {
+  unsigned rate = 8000;
+  double peak = 0.98;
+  bool dither = true;
+  unsigned seed = 1;
+  bool adpcm = false;
+};
+
+static std::vector<uint8_t> quantise(std::vector<double> x, const Options& opt, std::mt19937& rng) {
+  if (opt.peak > 0) {
+    double peak = 0;
+    for (double v : x)
+      peak = std::max(peak, std::fabs(v));
+    if (peak > 0)
+      for (double& v : x)
+        v *= opt.peak / peak;
+  }
+  std::uniform_real_distribution<double> u(-0.5, 0.5);
+  std::vector<uint8_t> out(x.size());
+  for (size_t i = 0; i < x.size(); i++) {
+    double v = x[i] * 127.0;
+    if (opt.dither)
+      v += u(rng) + u(rng); // triangular, +/-1 LSB
+    long q = std::lround(v);
+    out[i] = uint8_t(int8_t(std::min(127L, std::max(-128L, q))));
+  }
+  return out;
+}
+
+static bool ends_with(const std::string& s, const char* suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && !s.compare(s.size() - n, n, suffix);
+}
+
+static void write_file(const std::string& path, const std::string& text) {
+  std::ofstream f(path);
+  f << text;
+  if (!f)
+    die("cannot write " + path);
+}
+
+// name as the upper-case identifier its localparams are named after.
+static std::string identifier(const std::string& name) {
+  std::string id;
+  for (char c : name)
+    id += isalnum((unsigned char)c) ? char(toupper((unsigned char)c)) : '_';
+  if (id.empty() || isdigit((unsigned char)id[0]))
+    id = "_" + id;
+  return id;
+}
+
+static std::string hex(uint32_t v, int digits) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%0*x", digits, v);
+  return buf;
+}
+
+int main(int argc, char** argv) {
+  Options opt;
+  std::string bank;
+  std::vector<std::pair<std::string, std::string>> inputs;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool more = i + 1 < argc;
+    if (arg == "-o" && more)
+      bank = argv[++i];
+    else if (arg == "--rate" && more)
+      opt.rate = std::strtoul(argv[++i], NULL, 0);
+    else if (arg == "--peak" && more)
+      opt.peak = std::strtod(argv[++i], NULL);
+    else if (arg == "--dither" && more)
+      opt.dither = std::string(argv[++i]) != "none";
+    else if (arg == "--seed" && more)
+      opt.seed = std::strtoul(argv[++i], NULL, 0);
+    else if (arg == "--adpcm")
+      opt.adpcm = true;
+    else if (arg.find('=') != std::string::npos && arg[0] != '-')
+      inputs.push_back({arg.substr(0, arg.find('=')), arg.substr(arg.find('=') + 1)});
+    else
+      usage();
+  }
+  if (bank.empty() || inputs.empty() || !opt.rate)
+    usage();
+
+  std::mt19937 rng(opt.seed);
+  SampleBank out;
+  std::vector<std::string> names, ids;
+  for (auto& in : inputs) {
+    std::string id = identifier(in.first);
+    if (std::find(ids.begin(), ids.end(), id) != ids.end())
+      die(in.first + ": another voice is also named " + id + " in " + bank + "_index.svh");
+    ids.push_back(id);
+    std::vector<uint8_t> voice;
+    if (ends_with(in.second, ".mem")) {
+      voice = load_mem(in.second, BANK_MAX_DEPTH);
+    }
+    else {
+      Audio a = read_wav(in.second);
+      voice = quantise(resample(a.samples, a.rate, opt.rate), opt, rng);
+    }
+    if (voice.size() > 0xffff)
+      die(in.first + ": " + std::to_string(voice.size()) + " samples is more than the index can describe");
+    out.voices.push_back({uint32_t(out.rom.size()), uint32_t(voice.size())});
+    if (opt.adpcm)
+      voice = adpcm_encode(std::vector<int8_t>(voice.begin(), voice.end()));
+    out.rom.insert(out.rom.end(), voice.begin(), voice.end());
+    names.push_back(in.first);
+  }
+  size_t used = out.rom.size();
+  out.rom.resize((used + BANK_BRAM_BYTES - 1) / BANK_BRAM_BYTES * BANK_BRAM_BYTES, 0);
+  if (out.rom.size() > BANK_MAX_DEPTH)
+    die("bank is " + std::to_string(out.rom.size()) + " bytes, more than the index can address");
+
+  std::string rom, index, svh;
+  rom.reserve(out.rom.size() * 3);
+  for (uint8_t b : out.rom)
+    rom += hex(b, 2) + "\n";
+  svh += "// Generated by tools/samplebank; do not edit.\n";
+  svh += "localparam BANK_DEPTH = " + std::to_string(out.rom.size()) + ";\n";
+  svh += "localparam BANK_VOICES = " + std::to_string(out.voices.size()) + ";\n";
+  svh += "localparam BANK_ADPCM = " + std::string(opt.adpcm ? "1" : "0") + ";\n";
+  for (size_t v = 0; v < out.voices.size(); v++) {
+    index += hex(SampleBank::pack(out.voices[v]), 8) + "\n";
+    svh += "localparam [15:0] " + ids[v] + "_START = 16'd" + std::to_string(out.voices[v].start) + ", " +
+           ids[v] + "_LEN = 16'd" + std::to_string(out.voices[v].length) + ";\n";
+  }
+  write_file(bank + ".mem", rom);
+  write_file(bank + "_index.mem", index);
+  write_file(bank + "_index.svh", svh);
+
+  // Read it back the way the testbenches will.
+  SampleBank check = load_sample_bank(bank);
+  if (check.rom != out.rom || check.voices.size() != out.voices.size())
+    die("read-back of " + bank + " does not match what was written");
+  for (size_t v = 0; v < out.voices.size(); v++)
+    if (check.samples(v, opt.adpcm).size() != out.voices[v].length)
+      die("read-back of voice " + names[v] + " has the wrong length");
+
+  for (size_t v = 0; v < out.voices.size(); v++)
+    printf("%-8s start %5u  length %5u\n", names[v].c_str(), out.voices[v].start, out.voices[v].length);
+  printf("%zu voices, %zu bytes in %zu x 4 Kbit BRAM, %zu bytes of padding\n", out.voices.size(), used,
+         out.brams(), out.rom.size() - used);
+  return 0;
+}
@@ -74,7 +74,7 @@ module ice40hx8k (hwclk,pb,ss7,ss6,ss5,ss4,ss3,ss2,ss1,ss0,left,right,red,green,
         .DIVR(4'b1100),        // 12
         .DIVF(7'b0000011),     // 3
         .DIVQ(3'b000),         // 0
-        .FILTER_RANGE(3'b001), // 1
+        .FILTER_RANGE(3'b001)  // 1
     ) pll (
         .REFERENCECLK (hwclk),
         .PLLOUTCORE   (serclk),
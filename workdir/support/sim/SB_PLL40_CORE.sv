@@ -0,0 +1,82 @@
+// Behavioral model of the iCE40 SB_PLL40_CORE, for simulating the board
+// wrapper (support/ice40hx8k.sv) with Verilator.  Synthesis never reads
+// this file; yosys maps the instance to the hard PLL.
+//
+// The output frequency follows the wrapper's own calculation:
+//
+//   PHASE_AND_DELAY:  Fref * (DIVF + 1) / (DIVR + 1)
+//   SIMPLE, DELAY:    Fref * (DIVF + 1) / (2^DIVQ * (DIVR + 1))
+//
+// There is no VCO.  Every edge of REFERENCECLK adds DIVF + 1 to a phase
+// accumulator and PLLOUTCORE toggles each time it passes the divisor, so
+// the output has exactly the right average frequency with every edge
+// on a reference edge (at most one reference half period of jitter).  It
+// costs no simulation time of its own, but it can only divide: an output
+// faster than REFERENCECLK is rejected at the start of simulation.
+//
+// BYPASS passes REFERENCECLK straight through, RESETB low holds the
+// output low, and LOCK rises with the first output edge.  The feedback,
+// delay and SPI ports are accepted and ignored.
+module SB_PLL40_CORE #(
+  parameter FEEDBACK_PATH = "SIMPLE",
+  parameter DELAY_ADJUSTMENT_MODE_FEEDBACK = "FIXED",
+  parameter DELAY_ADJUSTMENT_MODE_RELATIVE = "FIXED",
+  parameter SHIFTREG_DIV_MODE = 1'b0,
+  parameter FDA_FEEDBACK = 4'b0000,
+  parameter FDA_RELATIVE = 4'b0000,
+  parameter PLLOUT_SELECT = "GENCLK",
+  parameter DIVR = 4'b0000,
+  parameter DIVF = 7'b0000000,
+  parameter DIVQ = 3'b000,
+  parameter FILTER_RANGE = 3'b000,
+  parameter ENABLE_ICEGATE = 1'b0,
+  parameter TEST_MODE = 1'b0,
+  parameter EXTERNAL_DIVIDE_FACTOR = 1
+) (
+  input  logic       REFERENCECLK,
+  output logic       PLLOUTCORE,
+  output logic       PLLOUTGLOBAL,
+  input  logic       EXTFEEDBACK,
+  input  logic [7:0] DYNAMICDELAY,
+  output logic       LOCK,
+  input  logic       BYPASS,
+  input  logic       RESETB,
+  input  logic       LATCHINPUTVALUE,
+  output logic       SDO,
+  input  logic       SDI,
+  input  logic       SCLK
+);
+  /* verilator lint_off UNUSEDPARAM */
+  /* verilator lint_off UNUSEDSIGNAL */
+
+  // output edges per reference edge, as STEP / LIMIT
+  localparam int STEP = DIVF + 1;
+  localparam int LIMIT = FEEDBACK_PATH == "PHASE_AND_DELAY" ? DIVR + 1 : (DIVR + 1) << DIVQ;
+
+  initial
+    if (STEP > LIMIT)
+      $fatal(1, "SB_PLL40_CORE model: output faster than REFERENCECLK (DIVF + 1 = %0d, divisor %0d)", STEP, LIMIT);
+
+  int phase = 0;
+  logic out = 0;
+  logic locked = 0;
+
+  always @(REFERENCECLK)
+    if (!RESETB) begin
+      phase <= 0;
+      out <= 0;
+      locked <= 0;
+    end
+    else if (phase + STEP >= LIMIT) begin
+      phase <= phase + STEP - LIMIT;
+      out <= ~out;
+      locked <= 1;
+    end
+    else
+      phase <= phase + STEP;
+
+  assign PLLOUTCORE = BYPASS ? REFERENCECLK : out;
+  assign PLLOUTGLOBAL = PLLOUTCORE;
+  assign LOCK = RESETB & locked;
+  assign SDO = 0;
+endmodule